@@ -7,4 +7,7 @@ struct audio_config {
     unsigned int sample_rate;
 };
 
+// What audio processes open the audio device with.
+const audio_config DEFAULT_AUDIO_CONFIG {256, 44100};
+
 }
\ No newline at end of file
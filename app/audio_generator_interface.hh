@@ -1,5 +1,7 @@
 #pragma once
 
+#include "audio_config.hh"
+
 namespace bzzt {
 
 using audio_generator_run_func = void (*)(
@@ -25,6 +27,101 @@ using audio_generator_input_count_func = unsigned int (*)();
 
 using audio_generator_output_count_func = unsigned int (*)();
 
+// Optional lane interface. A generator exporting it keeps the states of lane_count() instances
+// structure-of-arrays in one block of size() bytes and advances them together; inputs and outputs
+// are laid out [port * lane_count() + lane] and only the lanes set in lane_mask may be advanced.
+// Lane generators do not need run, init and deinit.
+
+using audio_generator_lane_count_func = unsigned int (*)();
+
+using audio_generator_run_lanes_func = void (*)(
+    float*       inputs,
+    float*       outputs,
+    void*        generator_block,
+    unsigned int lane_mask,
+    unsigned int sample_rate
+);
+
+using audio_generator_init_lane_func = unsigned int (*)(
+    void*        generator_block,
+    unsigned int lane
+);
+
+using audio_generator_deinit_lane_func = void (*)(
+    void*        generator_block,
+    unsigned int lane
+);
+
+// Optional. Given inputs that hold these values for a whole block (silent buffers read as zero),
+// returns non-zero when running the generator would output only zeros and leave its state as is.
+// The pipeline then skips the generator for that block.
+using audio_generator_is_idle_func = unsigned int (*)(
+    float const* inputs,
+    void*        generator
+);
+
+// Optional. Fills in what the pipeline may assume about the generator. Fields left alone keep the
+// defaults of a stateful generator with no latency and a tail that never ends.
+
+// The outputs depend on nothing but the inputs of the same sample.
+const unsigned int AUDIO_GENERATOR_STATELESS {1u << 0};
+// The outputs may be written over the buffers the inputs were read from.
+const unsigned int AUDIO_GENERATOR_IN_PLACE  {1u << 1};
+
+struct audio_generator_capabilities {
+    unsigned int flags;
+
+    // Samples by which the outputs lag behind the inputs.
+    unsigned int latency;
+
+    // Samples the outputs keep sounding after all inputs fall silent, 0xffffffff when they never stop.
+    unsigned int tail_length;
+};
+
+using audio_generator_capabilities_func = void (*)(
+    audio_generator_capabilities* capabilities
+);
+
+// Optional. Called after init, and again whenever the rate or block size of the instance changes,
+// so coefficients derived from them can be computed once instead of on every sample. The config
+// holds the samples the instance runs per block and its sample rate, as two unsigned ints.
+using audio_generator_prepare_func = void (*)(
+    void*               generator,
+    audio_config const* config
+);
+
+using audio_generator_prepare_lane_func = void (*)(
+    void*               generator_block,
+    unsigned int        lane,
+    audio_config const* config
+);
+
+// Optional data shared by all instances of a generator. type_data_size() bytes aligned to a cache
+// line are handed to init_type once when the generator is compiled, and then passed read-only to
+// every instance through the shared variants of run and run_lanes, which take their place.
+using audio_generator_type_data_size_func = unsigned int (*)();
+
+using audio_generator_init_type_func = unsigned int (*)(
+    void* type_data
+);
+
+using audio_generator_run_shared_func = void (*)(
+    float*       inputs,
+    float*       outputs,
+    void*        generator,
+    void const*  type_data,
+    unsigned int sample_rate
+);
+
+using audio_generator_run_lanes_shared_func = void (*)(
+    float*       inputs,
+    float*       outputs,
+    void*        generator_block,
+    void const*  type_data,
+    unsigned int lane_mask,
+    unsigned int sample_rate
+);
+
 struct audio_generator_interface {
     audio_generator_run_func run;
     audio_generator_init_func init;
@@ -33,6 +130,21 @@ struct audio_generator_interface {
     audio_generator_size_func size;
     audio_generator_input_count_func input_count;
     audio_generator_output_count_func output_count;
+
+    audio_generator_lane_count_func lane_count;
+    audio_generator_run_lanes_func run_lanes;
+    audio_generator_init_lane_func init_lane;
+    audio_generator_deinit_lane_func deinit_lane;
+
+    audio_generator_is_idle_func is_idle;
+    audio_generator_capabilities_func capabilities;
+    audio_generator_prepare_func prepare;
+    audio_generator_prepare_lane_func prepare_lane;
+
+    audio_generator_type_data_size_func type_data_size;
+    audio_generator_init_type_func init_type;
+    audio_generator_run_shared_func run_shared;
+    audio_generator_run_lanes_shared_func run_lanes_shared;
 };
 
 }
\ No newline at end of file
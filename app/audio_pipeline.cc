@@ -1,19 +1,35 @@
 #include "audio_pipeline.hh"
 
 #include <map>
+#include <set>
 #include <vector>
-#include <array>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <memory>
 #include <limits.h>
 #include <libtcc.h>
 #include "audio_generator_interface.hh"
+#include "oversampling.hh"
+#include "generator_runtime.hh"
 
 namespace bzzt {
 
 namespace {
 
-const unsigned int MAX_INPUT_PARAMETERS {8};
-const unsigned int MAX_OUTPUT_PARAMETERS {8};
+// Widest lane block a generator may ask for, lane masks are one bit per lane.
+const unsigned int MAX_LANES {16};
+
+const unsigned int TYPE_DATA_ALIGNMENT {64};
+
+const unsigned int DEFAULT_CONTROL_BLOCK_SIZE {32};
+
+const unsigned int MAX_OVERSAMPLING {8};
+
+const unsigned int BUS_CHUNK_SIZE {16};
+
+const unsigned int RESERVED_EVENTS {1024};
 
 const audio_pipeline::generator_type_handle INVALID_GENERATOR_TYPE_HANDLE {UINT_MAX};
 const audio_pipeline::generator_handle      INVALID_GENERATOR_HANDLE      {INVALID_GENERATOR_TYPE_HANDLE, UINT_MAX};
@@ -26,27 +42,74 @@ unsigned int get_generator_state_index (audio_pipeline::generator_handle const&
     return std::get<1>(handle);
 }
 
-struct pipeline_step {
-    audio_generator_run_func render_func;
+struct step_oversampling {
+    std::vector<oversampler> inputs;
+    std::vector<oversampler> outputs;
+};
 
-    audio_pipeline::generator_type_handle generator_type;
-    unsigned int state_index;
+unsigned int bus_init(void*) {
+    return 1;
+}
 
-    unsigned int inputs;
-    unsigned int outputs;
-};
+void bus_deinit(void*) {
+}
+
+char const* bus_id() {
+    return "bus";
+}
+
+unsigned int bus_size() {
+    return sizeof(float);
+}
+
+// Not linked yet, null if the code does not compile.
+TCCState* compile_generator_code(std::string const& code) {
+    auto source {get_generator_runtime_header() + code};
+    TCCState* tcc_state {tcc_new()};
+    if (!tcc_state) {
+        return nullptr;
+    }
+    tcc_set_output_type(tcc_state, TCC_OUTPUT_MEMORY);
+    if (tcc_compile_string(tcc_state, source.c_str()) == -1) {
+        tcc_delete(tcc_state);
+        return nullptr;
+    }
+    return tcc_state;
+}
+
+// Not linked yet, null if the object can not be read.
+TCCState* load_generator_object(std::string const& object_path) {
+    TCCState* tcc_state {tcc_new()};
+    if (!tcc_state) {
+        return nullptr;
+    }
+    tcc_set_output_type(tcc_state, TCC_OUTPUT_MEMORY);
+    if (tcc_add_file(tcc_state, object_path.c_str()) == -1) {
+        tcc_delete(tcc_state);
+        return nullptr;
+    }
+    return tcc_state;
+}
 
 struct audio_generator_impl {
-    audio_generator_impl(std::string const& code) {
-        TCCState* tcc_state {tcc_new()};
+    audio_generator_impl() = default;
+
+    explicit audio_generator_impl(unsigned int sources) : inputs{sources * 2}, outputs{1}, bus_sources{sources} {
+        generator_impl.init   = &bus_init;
+        generator_impl.deinit = &bus_deinit;
+        generator_impl.id     = &bus_id;
+        generator_impl.size   = &bus_size;
+        capabilities = {AUDIO_GENERATOR_STATELESS | AUDIO_GENERATOR_IN_PLACE, 0, 0};
+    }
+
+    audio_generator_impl(std::string const& code) : audio_generator_impl{compile_generator_code(code)} {}
+
+    // Links the state and takes it over.
+    explicit audio_generator_impl(TCCState* tcc_state) {
         if (!tcc_state) {
             return;
         }
-        tcc_set_output_type(tcc_state, TCC_OUTPUT_MEMORY);
-        if (tcc_compile_string(tcc_state, code.c_str()) == -1) {
-            tcc_delete(tcc_state);
-            return;
-        }
+        add_generator_runtime_symbols(tcc_state);
         auto memory_size {tcc_relocate(tcc_state, nullptr)};
         if (!memory_size) {
             tcc_delete(tcc_state);
@@ -67,6 +130,41 @@ struct audio_generator_impl {
         generator_impl.input_count  = (audio_generator_input_count_func)  (tcc_get_symbol(tcc_state, "input_count"));
         generator_impl.output_count = (audio_generator_output_count_func) (tcc_get_symbol(tcc_state, "output_count"));
 
+        generator_impl.lane_count   = (audio_generator_lane_count_func)   (tcc_get_symbol(tcc_state, "lane_count"));
+        generator_impl.run_lanes    = (audio_generator_run_lanes_func)    (tcc_get_symbol(tcc_state, "run_lanes"));
+        generator_impl.init_lane    = (audio_generator_init_lane_func)    (tcc_get_symbol(tcc_state, "init_lane"));
+        generator_impl.deinit_lane  = (audio_generator_deinit_lane_func)  (tcc_get_symbol(tcc_state, "deinit_lane"));
+
+        generator_impl.is_idle      = (audio_generator_is_idle_func)      (tcc_get_symbol(tcc_state, "is_idle"));
+        generator_impl.capabilities = (audio_generator_capabilities_func) (tcc_get_symbol(tcc_state, "capabilities"));
+        generator_impl.prepare      = (audio_generator_prepare_func)      (tcc_get_symbol(tcc_state, "prepare"));
+        generator_impl.prepare_lane = (audio_generator_prepare_lane_func) (tcc_get_symbol(tcc_state, "prepare_lane"));
+
+        generator_impl.type_data_size   = (audio_generator_type_data_size_func)   (tcc_get_symbol(tcc_state, "type_data_size"));
+        generator_impl.init_type        = (audio_generator_init_type_func)        (tcc_get_symbol(tcc_state, "init_type"));
+        generator_impl.run_shared       = (audio_generator_run_shared_func)       (tcc_get_symbol(tcc_state, "run_shared"));
+        generator_impl.run_lanes_shared = (audio_generator_run_lanes_shared_func) (tcc_get_symbol(tcc_state, "run_lanes_shared"));
+
+        auto runs_lanes {generator_impl.run_lanes || generator_impl.run_lanes_shared};
+        if (generator_impl.lane_count && runs_lanes && generator_impl.init_lane && generator_impl.deinit_lane) {
+            lanes = generator_impl.lane_count();
+        }
+        if (generator_impl.type_data_size && generator_impl.init_type) {
+            auto size {generator_impl.type_data_size()};
+            type_data_memory = new char[size + TYPE_DATA_ALIGNMENT]();
+            void* aligned {type_data_memory};
+            auto space {static_cast<std::size_t>(size + TYPE_DATA_ALIGNMENT)};
+            type_data = std::align(TYPE_DATA_ALIGNMENT, size, aligned, space);
+            type_data_ready = generator_impl.init_type(type_data) != 0;
+        }
+        if (generator_impl.capabilities) {
+            generator_impl.capabilities(&capabilities);
+        }
+        if (generator_impl.input_count && generator_impl.output_count) {
+            inputs = generator_impl.input_count();
+            outputs = generator_impl.output_count();
+        }
+
         tcc_delete(tcc_state);
     }
 
@@ -76,13 +174,31 @@ struct audio_generator_impl {
     audio_generator_impl(audio_generator_impl&& other) {
         build_memory = other.build_memory;
         generator_impl = other.generator_impl;
+        inputs = other.inputs;
+        outputs = other.outputs;
+        bus_sources = other.bus_sources;
+        lanes = other.lanes;
+        capabilities = other.capabilities;
+        type_data_memory = other.type_data_memory;
+        type_data = other.type_data;
+        type_data_ready = other.type_data_ready;
         other.build_memory = nullptr;
+        other.type_data_memory = nullptr;
     }
 
     audio_generator_impl& operator=(audio_generator_impl&& other) {
         build_memory = other.build_memory;
         generator_impl = other.generator_impl;
+        inputs = other.inputs;
+        outputs = other.outputs;
+        bus_sources = other.bus_sources;
+        lanes = other.lanes;
+        capabilities = other.capabilities;
+        type_data_memory = other.type_data_memory;
+        type_data = other.type_data;
+        type_data_ready = other.type_data_ready;
         other.build_memory = nullptr;
+        other.type_data_memory = nullptr;
         return *this;
     }
 
@@ -90,59 +206,370 @@ struct audio_generator_impl {
         if (build_memory) {
             delete[] static_cast<char*>(build_memory);
         }
+        if (type_data_memory) {
+            delete[] type_data_memory;
+        }
     }
 
     bool valid() const {
         auto const& x {generator_impl};
-        return x.run && x.init && x.deinit && x.id && x.size && x.input_count && x.output_count;
+        auto runnable {((x.run || x.run_shared || bus_sources > 0) && x.init && x.deinit) || (lanes > 0 && lanes <= MAX_LANES)};
+        auto shared_ready {(!x.run_shared && !x.run_lanes_shared) || type_data_ready};
+        auto counted {(x.input_count && x.output_count) || bus_sources > 0};
+        return runnable && shared_ready && counted && x.id && x.size;
+    }
+
+    void run(float* inputs, float* outputs, void* generator, unsigned int sample_rate) const {
+        if (bus_sources > 0) {
+            auto sum {0.0f};
+            for (unsigned int source {0}; source < bus_sources; ++source) {
+                sum += inputs[source * 2] * inputs[source * 2 + 1];
+            }
+            outputs[0] = sum;
+        } else if (generator_impl.run_shared) {
+            generator_impl.run_shared(inputs, outputs, generator, type_data, sample_rate);
+        } else {
+            generator_impl.run(inputs, outputs, generator, sample_rate);
+        }
+    }
+
+    void run_lanes(float* inputs, float* outputs, void* generator_block, unsigned int lane_mask, unsigned int sample_rate) const {
+        if (generator_impl.run_lanes_shared) {
+            generator_impl.run_lanes_shared(inputs, outputs, generator_block, type_data, lane_mask, sample_rate);
+        } else {
+            generator_impl.run_lanes(inputs, outputs, generator_block, lane_mask, sample_rate);
+        }
     }
 
     void* build_memory {nullptr};
-    audio_generator_interface generator_impl {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr};
+    audio_generator_interface generator_impl {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr};
+
+    unsigned int inputs {0};
+    unsigned int outputs {0};
+    unsigned int bus_sources {0};
+
+    unsigned int lanes {0};
+
+    audio_generator_capabilities capabilities {0, 0, UINT_MAX};
+
+    char* type_data_memory {nullptr};
+    void* type_data {nullptr};
+    bool type_data_ready {false};
 };
 
 struct generator_input_param {
-    generator_input_param() : is_buffer{false} {
+    generator_input_param() : is_buffer{false}, ramp_remaining{0}, ramp_step{0.0f}, ramp_target{0.0f}, ramp_exponential{false} {
         value = 0.0f;
     }
 
+    bool is_ramping() const {
+        return !is_buffer && ramp_remaining > 0;
+    }
+
+    void set_value(float new_value) {
+        is_buffer = false;
+        value = new_value;
+        ramp_remaining = 0;
+    }
+
     bool is_buffer;
     union {
         unsigned int buffer_id;
         float value;
     };
+
+    // Linear ramps add ramp_step per sample, exponential ones multiply by it.
+    unsigned int ramp_remaining;
+    float ramp_step;
+    float ramp_target;
+    bool ramp_exponential;
+
+    // Delay line for latency compensation.
+    unsigned int delay {0};
+    std::vector<float> delay_line {};
+
+    // Last sample of the previous block for loop back inputs.
+    bool loop_back {false};
+    float loop_carry {0.0f};
 };
 
+const unsigned int RAMP_LANES {8};
+
+void render_ramp(generator_input_param& param, float* out, unsigned int count) {
+    auto ramp_count {std::min(count, param.ramp_remaining)};
+    auto value {param.value};
+
+    if (param.ramp_exponential) {
+        float lane_factors[RAMP_LANES];
+        lane_factors[0] = 1.0f;
+        for (unsigned int lane {1}; lane < RAMP_LANES; ++lane) {
+            lane_factors[lane] = lane_factors[lane - 1] * param.ramp_step;
+        }
+        auto block_factor {lane_factors[RAMP_LANES - 1] * param.ramp_step};
+
+        unsigned int i {0};
+        for (; i + RAMP_LANES <= ramp_count; i += RAMP_LANES) {
+            for (unsigned int lane {0}; lane < RAMP_LANES; ++lane) {
+                out[i + lane] = value * lane_factors[lane];
+            }
+            value *= block_factor;
+        }
+        for (unsigned int lane {0}; i < ramp_count; ++i, ++lane) {
+            out[i] = value * lane_factors[lane];
+        }
+        value *= lane_factors[ramp_count % RAMP_LANES];
+    } else {
+        for (unsigned int i {0}; i < ramp_count; ++i) {
+            out[i] = value + param.ramp_step * static_cast<float>(i);
+        }
+        value += param.ramp_step * static_cast<float>(ramp_count);
+    }
+
+    param.ramp_remaining -= ramp_count;
+    param.value = param.ramp_remaining > 0 ? value : param.ramp_target;
+    std::fill(out + ramp_count, out + count, param.ramp_target);
+}
+
 struct generator_output_param {
-    generator_output_param() : buffer_id{UINT_MAX} {}
+    generator_output_param() : buffer_id{UINT_MAX}, control_from{0.0f}, control_to{0.0f} {}
 
     unsigned int buffer_id;
+
+    float control_from;
+    float control_to;
+};
+
+enum class step_rate {
+    audio,
+    control_hold,
+    control_linear
+};
+
+struct pipeline_step {
+    audio_pipeline::generator_type_handle generator_type;
+    unsigned int state_index;
+
+    // lane is UINT_MAX for generators without lanes.
+    unsigned int state_offset;
+    unsigned int lane;
+
+    unsigned int inputs;
+    unsigned int outputs;
+    std::vector<generator_input_param> input_params;
+    std::vector<generator_output_param> output_params;
+
+    audio_pipeline::voice_pool_handle voice_pool {UINT_MAX};
+    unsigned int voice {UINT_MAX};
+
+    step_rate rate {step_rate::audio};
+
+    unsigned int oversampling {1};
+    unsigned int oversampling_state {UINT_MAX};
+
+    unsigned int silent_input_samples {0};
+};
+
+struct generator_state_slot {
+    unsigned int state_index;
+    unsigned int state_offset;
+    unsigned int lane;
+};
+
+// Zero means silence.
+struct buffer_flags {
+    bool constant;
+    float value;
+
+    bool silent() const {
+        return constant && value == 0.0f;
+    }
+};
+
+struct parameter_event {
+    unsigned int sample_offset;
+    audio_pipeline::generator_handle generator;
+    unsigned int input_id;
+    float value;
+};
+
+struct voice_trigger_input {
+    audio_pipeline::generator_handle generator;
+    unsigned int input_id;
+    audio_pipeline::voice_trigger trigger;
+};
+
+struct voice {
+    audio_pipeline::buffer_handle output;
+    std::vector<voice_trigger_input> trigger_inputs;
+
+    bool active;
+    bool held;
+    float note;
+    unsigned long long started;
+    float peak;
+};
+
+struct voice_pool {
+    audio_pipeline::voice_steal_policy policy;
+    audio_pipeline::buffer_handle mix_buffer;
+    std::vector<voice> voices;
+    unsigned long long note_count;
+};
+
+const float VOICE_SILENCE_THRESHOLD {1.0e-4f};
+
+// Instances sharing a lane block, or the steps of a feedback loop.
+struct step_group {
+    unsigned int first_step;
+    unsigned int step_count;
+    bool per_sample {false};
+};
+
+struct feedback_buffer {
+    audio_pipeline::buffer_handle buffer;
+    std::vector<float> previous;
+    buffer_flags previous_flags;
+};
+
+struct buffer_access {
+    unsigned int step_position;
+    bool write;
+};
+
+struct resolved_parameter_event {
+    unsigned int step_position;
+    unsigned int sample_offset;
+    unsigned int input_id;
+    float value;
 };
 
 }
 
+struct audio_pipeline::compiled_generator_type {
+    explicit compiled_generator_type(std::string const& code) : generator{code} {}
+    explicit compiled_generator_type(TCCState* tcc_state) : generator{tcc_state} {}
+
+    audio_generator_impl generator;
+};
+
 struct audio_pipeline::impl {
     audio_config audio_conf;
+    unsigned int control_block_size {DEFAULT_CONTROL_BLOCK_SIZE};
 
     std::vector<pipeline_step> pipeline;
-    std::array<std::vector<generator_input_param>,  MAX_INPUT_PARAMETERS>  pipeline_inputs;
-    std::array<std::vector<generator_output_param>, MAX_OUTPUT_PARAMETERS> pipeline_outputs;
+
+    unsigned int max_inputs {0};
+    unsigned int max_outputs {0};
+    std::vector<float> input_scratch;
+    std::vector<float> output_scratch;
+    std::vector<float const*> source_scratch;
+    std::vector<unsigned int> stride_scratch;
 
     std::map<audio_pipeline::generator_type_handle, std::vector<char>> generator_states;
     std::map<audio_pipeline::generator_type_handle, std::vector<bool>> generator_states_occupied;
 
+    // Free lists, the occupied flags only guard against double release.
+    std::map<audio_pipeline::generator_type_handle, std::vector<unsigned int>> generator_states_free;
+
     std::vector<std::vector<float>> buffers;
     std::vector<bool> buffers_occupied;
+    std::vector<audio_pipeline::buffer_handle> buffers_free;
+    std::vector<buffer_flags> buffers_flags;
+
+    std::vector<unsigned int> buffers_feedback;
+    std::vector<feedback_buffer> feedback_buffers;
+
+    std::vector<std::tuple<audio_pipeline::generator_handle, audio_pipeline::generator_handle>> feedback_loops;
+    std::vector<unsigned int> loop_event_cursors;
 
     std::vector<audio_generator_impl> generator_implementations;
+    std::vector<audio_pipeline::generator_type_handle> generator_implementations_free;
+
+    std::map<unsigned int, audio_pipeline::generator_type_handle> bus_types;
+    std::vector<float> bus_constants;
+
+    std::vector<parameter_event> parameter_events;
+    std::vector<resolved_parameter_event> block_events;
+
+    std::vector<float> ramp_values;
+
+    std::vector<voice_pool> voice_pools;
+
+    std::vector<std::tuple<unsigned int, audio_pipeline::voice_pool_handle>> voice_pool_mix_positions;
 
-    audio_pipeline::generator_type_handle add_generator_type(std::string const& generator_code) {
-        audio_generator_impl impl {generator_code};
+    std::vector<step_group> plan;
+    bool plan_dirty {true};
+
+    std::vector<std::tuple<audio_pipeline::generator_handle, unsigned int>> planned_positions;
+
+    std::vector<unsigned int> batched_steps;
+    std::vector<unsigned int> evented_steps;
+
+    unsigned int skipped_step_count {0};
+
+    std::vector<unsigned int> buffer_latencies;
+
+    std::vector<step_oversampling> oversampling_states;
+    std::vector<bool> oversampling_states_occupied;
+
+    // Sized for the highest factor on first use.
+    std::vector<float> oversampled_inputs;
+    std::vector<float> oversampled_outputs;
+    std::vector<float> oversampling_work;
+
+    audio_pipeline::generator_type_handle add_generator_type(audio_generator_impl&& impl) {
         if (!impl.valid()) {
             return INVALID_GENERATOR_TYPE_HANDLE;
         }
-        generator_implementations.push_back(std::move(impl));
-        return generator_implementations.size() - 1;
+        return insert_generator_type(std::move(impl));
+    }
+
+    audio_pipeline::generator_type_handle insert_generator_type(audio_generator_impl&& impl) {
+        if (generator_implementations_free.empty()) {
+            generator_implementations.push_back(std::move(impl));
+            return generator_implementations.size() - 1;
+        }
+        auto type {generator_implementations_free.back()};
+        generator_implementations_free.pop_back();
+        generator_implementations[type] = std::move(impl);
+        return type;
+    }
+
+    bool delete_generator_type(audio_pipeline::generator_type_handle type) {
+        if (type >= generator_implementations.size() || !generator_implementations[type].valid()) {
+            return false;
+        }
+        if (generator_states_inited_for_type(type)) {
+            auto const& states_occupied {generator_states_occupied[type]};
+            if (std::find(std::begin(states_occupied), std::end(states_occupied), true) != std::end(states_occupied)) {
+                return false;
+            }
+            generator_states.erase(type);
+            generator_states_occupied.erase(type);
+            generator_states_free.erase(type);
+        }
+        if (generator_implementations[type].bus_sources > 0) {
+            bus_types.erase(generator_implementations[type].bus_sources);
+        }
+
+        // Moved out first, assigning over the slot would not free its code.
+        audio_generator_impl released {std::move(generator_implementations[type])};
+        generator_implementations[type] = audio_generator_impl {};
+        generator_implementations_free.push_back(type);
+        return true;
+    }
+
+    audio_pipeline::generator_type_handle add_bus_type(unsigned int sources) {
+        if (sources == 0) {
+            return INVALID_GENERATOR_TYPE_HANDLE;
+        }
+        auto iter {bus_types.find(sources)};
+        if (iter != bus_types.end()) {
+            return iter->second;
+        }
+        auto type {insert_generator_type(audio_generator_impl {sources})};
+        bus_types[sources] = type;
+        return type;
     }
 
     void init_generator_states_for_type(audio_pipeline::generator_type_handle type) {
@@ -151,6 +578,8 @@ struct audio_pipeline::impl {
 
         generator_states_occupied[type] = std::vector<bool>{};
         generator_states_occupied[type].reserve(8192);
+
+        generator_states_free[type] = std::vector<unsigned int>{};
     }
 
     bool generator_states_inited_for_type(audio_pipeline::generator_type_handle type) const {
@@ -158,53 +587,220 @@ struct audio_pipeline::impl {
     }
 
     audio_pipeline::generator_handle add_generator(audio_pipeline::generator_type_handle type, unsigned int position) {
+        auto slot {allocate_generator_state(type)};
+        if (slot.state_index == UINT_MAX) {
+            return INVALID_GENERATOR_HANDLE;
+        }
+
+        insert_step(position, type, slot.state_index, slot.state_offset, slot.lane);
+        prepare_step(position);
+        return {type, slot.state_index};
+    }
+
+    // UINT_MAX on failure.
+    generator_state_slot allocate_generator_state(audio_pipeline::generator_type_handle type) {
         if (!generator_states_inited_for_type(type)) {
             init_generator_states_for_type(type);
         }
 
+        auto const& generator_impl {generator_implementations[type]};
+        if (generator_impl.lanes > 0) {
+            return allocate_lane_state(type);
+        }
+
         auto& states {generator_states[type]};
         auto& states_occupied {generator_states_occupied[type]};
-        unsigned int state_position;
+        auto& states_free {generator_states_free[type]};
+        auto const& generator_interface {generator_impl.generator_impl};
+
+        if (states_free.empty()) {
+            states.resize(states.size() + generator_interface.size(), static_cast<char>(0));
+            states_occupied.push_back(false);
+            states_free.push_back(states_occupied.size() - 1);
+        }
+        auto vacant_position {states_free.back()};
+        auto state_position {vacant_position * generator_interface.size()};
+
+        if (!generator_interface.init(static_cast<void*>(&states[state_position]))) {
+            return {UINT_MAX, UINT_MAX, UINT_MAX};
+        }
+        states_free.pop_back();
+        states_occupied[vacant_position] = true;
 
-        auto const& generator_interface {generator_implementations[type].generator_impl};
+        return {state_position, state_position, UINT_MAX};
+    }
 
-        auto vacant_position_iter {std::find(std::begin(states_occupied), std::end(states_occupied), false)};
-        if (vacant_position_iter != std::end(states_occupied)) {
-            auto vacant_position {std::distance(std::begin(states_occupied), vacant_position_iter)};
-            state_position = static_cast<unsigned int>(vacant_position * generator_interface.size());
-            auto state_pointer {static_cast<void*>(&states[state_position])};
-            if (!generator_interface.init(state_pointer)) {
-                return INVALID_GENERATOR_HANDLE;
+    // slot / lanes is the state block, slot % lanes the lane in it.
+    generator_state_slot allocate_lane_state(audio_pipeline::generator_type_handle type) {
+        auto& states {generator_states[type]};
+        auto& states_occupied {generator_states_occupied[type]};
+        auto& states_free {generator_states_free[type]};
+        auto const& generator_impl {generator_implementations[type]};
+        auto const& generator_interface {generator_impl.generator_impl};
+
+        if (states_free.empty()) {
+            auto first_slot {static_cast<unsigned int>(states_occupied.size())};
+            states.resize(states.size() + generator_interface.size(), static_cast<char>(0));
+            states_occupied.resize(states_occupied.size() + generator_impl.lanes, false);
+            for (unsigned int lane {generator_impl.lanes}; lane > 0; --lane) {
+                states_free.push_back(first_slot + lane - 1);
             }
-            *vacant_position_iter = true;
-        } else {
-            state_position = states.size();
-            for (unsigned int i {0}; i < generator_interface.size(); ++i) {
-                states.push_back(static_cast<char>(0));
+        }
+        auto slot {states_free.back()};
+        auto block_offset {(slot / generator_impl.lanes) * generator_interface.size()};
+        auto lane {slot % generator_impl.lanes};
+
+        if (!generator_interface.init_lane(static_cast<void*>(&states[block_offset]), lane)) {
+            return {UINT_MAX, UINT_MAX, UINT_MAX};
+        }
+        states_free.pop_back();
+        states_occupied[slot] = true;
+
+        return {slot, block_offset, lane};
+    }
+
+    bool release_generator_state(audio_pipeline::generator_type_handle type, unsigned int slot) {
+        auto& states_occupied {generator_states_occupied[type]};
+        if (slot >= states_occupied.size() || !states_occupied[slot]) {
+            return false;
+        }
+        states_occupied[slot] = false;
+        generator_states_free[type].push_back(slot);
+        return true;
+    }
+
+    void insert_step(unsigned int position, audio_pipeline::generator_type_handle type, unsigned int state_index, unsigned int state_offset, unsigned int lane) {
+        auto const& generator_impl {generator_implementations[type]};
+
+        auto input_count {generator_impl.inputs};
+        auto output_count {generator_impl.outputs};
+        auto new_pipeline_step {pipeline_step {type, state_index, state_offset, lane, input_count, output_count,
+            std::vector<generator_input_param>(input_count), std::vector<generator_output_param>(output_count)}};
+        for (unsigned int source {0}; source < generator_impl.bus_sources; ++source) {
+            new_pipeline_step.input_params[source * 2 + 1].set_value(1.0f);
+        }
+        pipeline.insert(std::begin(pipeline) + position, std::move(new_pipeline_step));
+
+        if (input_count > max_inputs || output_count > max_outputs) {
+            max_inputs = std::max(max_inputs, input_count);
+            max_outputs = std::max(max_outputs, output_count);
+            input_scratch.resize(std::max(max_inputs, 1u) * MAX_LANES);
+            output_scratch.resize(std::max(max_outputs, 1u) * MAX_LANES);
+            source_scratch.resize(std::max(max_inputs, 1u) * MAX_LANES);
+            stride_scratch.resize(std::max(max_inputs, 1u) * MAX_LANES);
+            if (!oversampling_work.empty()) {
+                resize_oversampling_scratch();
             }
-            states_occupied.push_back(true);
+        }
+        plan_dirty = true;
+    }
+
+    audio_config step_audio_config(pipeline_step const& step) const {
+        if (step.rate != step_rate::audio) {
+            return {audio_conf.buffer_size / control_block_size, step_sample_rate(step)};
+        }
+        return {audio_conf.buffer_size * step.oversampling, step_sample_rate(step)};
+    }
+
+    void prepare_step(unsigned int step_position) {
+        auto const& step {pipeline[step_position]};
+        auto const& generator_interface {generator_implementations[step.generator_type].generator_impl};
+        auto config {step_audio_config(step)};
+        auto state {static_cast<void*>(&generator_states[step.generator_type][step.state_offset])};
+        if (step.lane != UINT_MAX && generator_interface.prepare_lane) {
+            generator_interface.prepare_lane(state, step.lane, &config);
+        } else if (step.lane == UINT_MAX && generator_interface.prepare) {
+            generator_interface.prepare(state, &config);
+        }
+    }
+
+    bool step_descriptions_valid(std::vector<audio_pipeline::step_description> const& steps) const {
+        auto buffer_valid {[&](audio_pipeline::buffer_handle handle) {
+            return handle < buffers_occupied.size() && buffers_occupied[handle];
+        }};
 
-            auto state_pointer {static_cast<void*>(&states[state_position])};
-            if (!generator_interface.init(state_pointer)) {
-                states_occupied.back() = false;
-                return INVALID_GENERATOR_HANDLE;
+        for (auto const& description : steps) {
+            if (description.type >= generator_implementations.size()) {
+                return false;
+            }
+            auto const& generator_impl {generator_implementations[description.type]};
+            if (description.inputs.size() != generator_impl.inputs || description.outputs.size() != generator_impl.outputs) {
+                return false;
+            }
+            auto factor {description.oversampling};
+            if ((factor != 1 && factor != 2 && factor != 4 && factor != MAX_OVERSAMPLING) || (factor != 1 && description.control_rate)) {
+                return false;
+            }
+            if (description.in_voice && (description.voice_pool >= voice_pools.size() || description.voice >= voice_pools[description.voice_pool].voices.size())) {
+                return false;
+            }
+            for (auto const& binding : description.inputs) {
+                if (binding.is_buffer && !buffer_valid(binding.buffer)) {
+                    return false;
+                }
+                if (binding.is_trigger && (binding.is_buffer || !description.in_voice)) {
+                    return false;
+                }
             }
+            for (auto buffer : description.outputs) {
+                if (!buffer_valid(buffer)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    audio_pipeline::buffer_handle allocate_buffer() {
+        if (!buffers_free.empty()) {
+            auto handle {buffers_free.back()};
+            buffers_free.pop_back();
+            buffers_occupied[handle] = true;
+            return handle;
         }
+        buffers.push_back(std::vector<float>{});
+        buffers.back().resize(audio_conf.buffer_size);
+        buffers_occupied.push_back(true);
+        buffers_flags.push_back({true, 0.0f});
+        buffers_feedback.push_back(UINT_MAX);
+        return buffers.size() - 1;
+    }
+
+    std::vector<float> const& readable_buffer(audio_pipeline::buffer_handle handle) const {
+        auto index {buffers_feedback[handle]};
+        return index == UINT_MAX ? buffers[handle] : feedback_buffers[index].previous;
+    }
 
-        auto new_pipeline_step {pipeline_step {generator_interface.run, type, state_position, generator_interface.input_count(), generator_interface.output_count()}};
-        pipeline.insert(std::begin(pipeline) + position, new_pipeline_step);
+    buffer_flags const& readable_buffer_flags(audio_pipeline::buffer_handle handle) const {
+        auto index {buffers_feedback[handle]};
+        return index == UINT_MAX ? buffers_flags[handle] : feedback_buffers[index].previous_flags;
+    }
+
+    bool buffer_is_feedback(audio_pipeline::buffer_handle handle) const {
+        return handle < buffers_feedback.size() && buffers_feedback[handle] != UINT_MAX;
+    }
 
-        for (auto& inputs : pipeline_inputs) {
-            inputs.insert(std::begin(inputs) + position, generator_input_param{});
+    void release_feedback_buffer(audio_pipeline::buffer_handle handle) {
+        auto index {buffers_feedback[handle]};
+        if (index == UINT_MAX) {
+            return;
         }
-        for (auto& outputs : pipeline_outputs) {
-            outputs.insert(std::begin(outputs) + position, generator_output_param{});
+        if (index + 1 != feedback_buffers.size()) {
+            feedback_buffers[index] = std::move(feedback_buffers.back());
+            buffers_feedback[feedback_buffers[index].buffer] = index;
         }
+        feedback_buffers.pop_back();
+        buffers_feedback[handle] = UINT_MAX;
+    }
 
-        return {type, state_position};
+    void swap_feedback_buffers() {
+        for (auto& feedback : feedback_buffers) {
+            std::swap(buffers[feedback.buffer], feedback.previous);
+            std::swap(buffers_flags[feedback.buffer], feedback.previous_flags);
+        }
     }
 
-    unsigned int get_generator_position(audio_pipeline::generator_handle ghandle) {
+    unsigned int get_generator_position(audio_pipeline::generator_handle ghandle) const {
         auto found_generator_iter {std::find_if(std::begin(pipeline), std::end(pipeline), [&](pipeline_step const& step) {
             return step.generator_type == get_generator_type(ghandle) && step.state_index == get_generator_state_index(ghandle);
         })};
@@ -213,54 +809,1282 @@ struct audio_pipeline::impl {
 
     void move_generator_to_position(audio_pipeline::generator_handle handle, unsigned int position) {
         auto generator_position {get_generator_position(handle)};
-        auto step {pipeline[generator_position]};
+        auto step {std::move(pipeline[generator_position])};
         pipeline.erase(std::begin(pipeline) + generator_position);
         if (position > pipeline.size()) {
             position = pipeline.size();
         }
-        pipeline.insert(std::begin(pipeline) + position, step);
+        pipeline.insert(std::begin(pipeline) + position, std::move(step));
+        plan_dirty = true;
+    }
+
+    void schedule_parameter_event(parameter_event const& event) {
+        auto insert_iter {std::upper_bound(std::begin(parameter_events), std::end(parameter_events), event, [](parameter_event const& a, parameter_event const& b) {
+            return a.sample_offset < b.sample_offset;
+        })};
+        parameter_events.insert(insert_iter, event);
+    }
 
-        for (auto& inputs : pipeline_inputs) {
-            auto input_param {inputs[generator_position]};
-            inputs.erase(std::begin(inputs) + generator_position);
-            inputs.insert(std::begin(inputs) + position, input_param);
+    // Needs the plan to be up to date.
+    void resolve_block_events() {
+        block_events.clear();
+        auto block_end_iter {std::lower_bound(std::begin(parameter_events), std::end(parameter_events), audio_conf.buffer_size, [](parameter_event const& event, unsigned int offset) {
+            return event.sample_offset < offset;
+        })};
+        for (auto iter {std::begin(parameter_events)}; iter != block_end_iter; ++iter) {
+            auto step_position {get_planned_generator_position(iter->generator)};
+            if (step_position == UINT_MAX || iter->input_id >= pipeline[step_position].inputs) {
+                continue;
+            }
+            block_events.push_back({step_position, iter->sample_offset, iter->input_id, iter->value});
         }
-        for (auto& outputs : pipeline_outputs) {
-            auto output_param {outputs[generator_position]};
-            outputs.erase(std::begin(outputs) + generator_position);
-            outputs.insert(std::begin(outputs) + position, output_param);
+        std::stable_sort(std::begin(block_events), std::end(block_events), [](resolved_parameter_event const& a, resolved_parameter_event const& b) {
+            return a.step_position < b.step_position;
+        });
+        parameter_events.erase(std::begin(parameter_events), block_end_iter);
+        for (auto& event : parameter_events) {
+            event.sample_offset -= audio_conf.buffer_size;
         }
     }
-};
 
-audio_pipeline::audio_pipeline(audio_config const& config) : internal{new audio_pipeline::impl} {
-    internal->audio_conf = config;
-    internal->pipeline.reserve(1024);
-}
+    void resolve_voice_pool_mix_positions() {
+        voice_pool_mix_positions.clear();
+        if (voice_pools.empty()) {
+            return;
+        }
+        std::vector<unsigned int> last_positions(voice_pools.size(), UINT_MAX);
+        for (unsigned int i {0}; i < pipeline.size(); ++i) {
+            if (pipeline[i].voice_pool != UINT_MAX) {
+                last_positions[pipeline[i].voice_pool] = i;
+            }
+        }
+        for (unsigned int pool {0}; pool < voice_pools.size(); ++pool) {
+            if (last_positions[pool] != UINT_MAX) {
+                voice_pool_mix_positions.push_back({last_positions[pool], pool});
+            }
+        }
+        std::sort(std::begin(voice_pool_mix_positions), std::end(voice_pool_mix_positions));
+    }
 
-audio_pipeline::~audio_pipeline() {
-    delete internal;
-}
+    bool step_reads_buffer(unsigned int step_position, unsigned int buffer_id) const {
+        for (unsigned int in {0}; in < pipeline[step_position].inputs; ++in) {
+            auto const& inparam {pipeline[step_position].input_params[in]};
+            if (inparam.is_buffer && inparam.buffer_id == buffer_id) {
+                return true;
+            }
+        }
+        return false;
+    }
 
-audio_pipeline::generator_type_handle audio_pipeline::add_generator_type(std::string const& generator_code) {
-    return internal->add_generator_type(generator_code);
-}
+    bool step_writes_buffer(unsigned int step_position, unsigned int buffer_id) const {
+        for (unsigned int out {0}; out < pipeline[step_position].outputs; ++out) {
+            if (pipeline[step_position].output_params[out].buffer_id == buffer_id) {
+                return true;
+            }
+        }
+        return false;
+    }
 
-bool audio_pipeline::generator_type_is_valid(audio_pipeline::generator_type_handle handle) const {
-    return handle != INVALID_GENERATOR_TYPE_HANDLE;
-}
+    // Lanes run side by side, so none may read a buffer another one writes.
+    bool step_independent_of(unsigned int step_position, unsigned int other_position) const {
+        for (unsigned int out {0}; out < pipeline[other_position].outputs; ++out) {
+            auto buffer_id {pipeline[other_position].output_params[out].buffer_id};
+            if (step_reads_buffer(step_position, buffer_id) || step_writes_buffer(step_position, buffer_id)) {
+                return false;
+            }
+        }
+        for (unsigned int out {0}; out < pipeline[step_position].outputs; ++out) {
+            if (step_reads_buffer(other_position, pipeline[step_position].output_params[out].buffer_id)) {
+                return false;
+            }
+        }
+        return true;
+    }
 
-audio_generator_interface const& audio_pipeline::get_generator_interface(audio_pipeline::generator_type_handle handle) const {
-    return internal->generator_implementations[handle].generator_impl;
-}
+    // UINT_MAX for ends no longer in the pipeline.
+    std::vector<std::tuple<unsigned int, unsigned int>> find_feedback_loop_positions() const {
+        std::map<audio_pipeline::generator_handle, unsigned int> ends {};
+        for (auto const& loop : feedback_loops) {
+            ends[std::get<0>(loop)] = UINT_MAX;
+            ends[std::get<1>(loop)] = UINT_MAX;
+        }
+        for (unsigned int i {0}; i < pipeline.size() && !ends.empty(); ++i) {
+            auto iter {ends.find({pipeline[i].generator_type, pipeline[i].state_index})};
+            if (iter != ends.end() && iter->second == UINT_MAX) {
+                iter->second = i;
+            }
+        }
 
-audio_pipeline::generator_handle audio_pipeline::add_generator_front(audio_pipeline::generator_type_handle type) {
-    return internal->add_generator(type, 0);
-}
+        std::vector<std::tuple<unsigned int, unsigned int>> positions {};
+        positions.reserve(feedback_loops.size());
+        for (auto const& loop : feedback_loops) {
+            positions.push_back({ends[std::get<0>(loop)], ends[std::get<1>(loop)]});
+        }
+        return positions;
+    }
 
-audio_pipeline::generator_handle audio_pipeline::add_generator_before(audio_pipeline::generator_type_handle type, audio_pipeline::generator_handle ghandle) {
-    return internal->add_generator(type, internal->get_generator_position(ghandle));
-}
+    // Loops overlapping an earlier one are left out.
+    std::vector<std::tuple<unsigned int, unsigned int>> resolve_feedback_loop_ranges() const {
+        std::vector<std::tuple<unsigned int, unsigned int>> ranges {};
+        for (auto position : find_feedback_loop_positions()) {
+            auto first {std::get<0>(position)};
+            auto last {std::get<1>(position)};
+            if (first == UINT_MAX || last == UINT_MAX) {
+                continue;
+            }
+            if (first > last) {
+                std::swap(first, last);
+            }
+            auto overlaps {std::any_of(std::begin(ranges), std::end(ranges), [&](std::tuple<unsigned int, unsigned int> const& range) {
+                return first <= std::get<1>(range) && last >= std::get<0>(range);
+            })};
+            if (!overlaps) {
+                ranges.push_back({first, last});
+            }
+        }
+        std::sort(std::begin(ranges), std::end(ranges));
+        return ranges;
+    }
+
+    std::vector<bool> find_steps_in_feedback_loops() const {
+        std::vector<bool> in_loop(pipeline.size(), false);
+        for (auto const& range : resolve_feedback_loop_ranges()) {
+            std::fill(std::begin(in_loop) + std::get<0>(range), std::begin(in_loop) + std::get<1>(range) + 1, true);
+        }
+        return in_loop;
+    }
+
+    // Loop ends move to the nearest step left, loops of removed steps alone go away.
+    void remove_steps_from_feedback_loops(std::vector<bool> const& removed) {
+        auto handle_at {[&](unsigned int position) {
+            return audio_pipeline::generator_handle {pipeline[position].generator_type, pipeline[position].state_index};
+        }};
+        auto positions {find_feedback_loop_positions()};
+        std::vector<std::tuple<audio_pipeline::generator_handle, audio_pipeline::generator_handle>> loops {};
+        for (unsigned int i {0}; i < feedback_loops.size(); ++i) {
+            auto first {std::get<0>(positions[i])};
+            auto last {std::get<1>(positions[i])};
+            if (first > last) {
+                std::swap(first, last);
+            }
+            if (last == UINT_MAX) {
+                loops.push_back(feedback_loops[i]);
+                continue;
+            }
+            while (first <= last && removed[first]) {
+                ++first;
+            }
+            while (first < last && removed[last]) {
+                --last;
+            }
+            if (first <= last) {
+                loops.push_back({handle_at(first), handle_at(last)});
+            }
+        }
+        feedback_loops = std::move(loops);
+    }
+
+    // Handles are reused, nothing may stay behind for the next generator.
+    void remove_generator_bindings(std::set<audio_pipeline::generator_handle> const& handles) {
+        auto removed {[&](audio_pipeline::generator_handle handle) {
+            return handles.find(handle) != handles.end();
+        }};
+        parameter_events.erase(std::remove_if(std::begin(parameter_events), std::end(parameter_events), [&](parameter_event const& event) {
+            return removed(event.generator);
+        }), std::end(parameter_events));
+        for (auto& pool : voice_pools) {
+            for (auto& v : pool.voices) {
+                v.trigger_inputs.erase(std::remove_if(std::begin(v.trigger_inputs), std::end(v.trigger_inputs), [&](voice_trigger_input const& trigger) {
+                    return removed(trigger.generator);
+                }), std::end(v.trigger_inputs));
+            }
+        }
+    }
+
+    bool release_generator(audio_pipeline::generator_handle handle) {
+        auto generator_type {get_generator_type(handle)};
+        auto generator_state_index {get_generator_state_index(handle)};
+        auto const& generator_interface {generator_implementations[generator_type].generator_impl};
+        auto lanes {generator_implementations[generator_type].lanes};
+
+        if (lanes > 0) {
+            if (!release_generator_state(generator_type, generator_state_index)) {
+                return false;
+            }
+            auto block_pointer {static_cast<void*>(&generator_states[generator_type][(generator_state_index / lanes) * generator_interface.size()])};
+            generator_interface.deinit_lane(block_pointer, generator_state_index % lanes);
+        } else {
+            if (!release_generator_state(generator_type, generator_state_index / generator_interface.size())) {
+                return false;
+            }
+            auto state_pointer {static_cast<void*>(&generator_states[generator_type][generator_state_index])};
+            generator_interface.deinit(state_pointer);
+        }
+        return true;
+    }
+
+    void erase_steps(std::vector<bool> const& removed) {
+        std::set<audio_pipeline::generator_handle> handles {};
+        for (unsigned int i {0}; i < pipeline.size(); ++i) {
+            if (removed[i]) {
+                audio_pipeline::generator_handle handle {pipeline[i].generator_type, pipeline[i].state_index};
+                release_generator(handle);
+                release_oversampling_state(pipeline[i]);
+                handles.insert(handle);
+            }
+        }
+        if (handles.empty()) {
+            return;
+        }
+        remove_steps_from_feedback_loops(removed);
+        remove_generator_bindings(handles);
+
+        unsigned int kept {0};
+        for (unsigned int i {0}; i < pipeline.size(); ++i) {
+            if (removed[i]) {
+                continue;
+            }
+            if (kept != i) {
+                pipeline[kept] = std::move(pipeline[i]);
+            }
+            ++kept;
+        }
+        pipeline.erase(std::begin(pipeline) + kept, std::end(pipeline));
+        plan_dirty = true;
+    }
+
+    void resolve_loop_back_inputs() {
+        for (auto& step : pipeline) {
+            for (auto& inparam : step.input_params) {
+                inparam.loop_back = false;
+            }
+        }
+        for (auto const& group : plan) {
+            if (!group.per_sample) {
+                continue;
+            }
+            auto group_end {group.first_step + group.step_count};
+            for (auto i {group.first_step}; i < group_end; ++i) {
+                for (auto& inparam : pipeline[i].input_params) {
+                    if (!inparam.is_buffer || buffer_is_feedback(inparam.buffer_id)) {
+                        continue;
+                    }
+                    for (auto writer {i}; writer < group_end && !inparam.loop_back; ++writer) {
+                        inparam.loop_back = step_writes_buffer(writer, inparam.buffer_id);
+                    }
+                }
+            }
+        }
+    }
+
+    void rebuild_plan() {
+        resolve_voice_pool_mix_positions();
+        auto loop_ranges {resolve_feedback_loop_ranges()};
+
+        plan.clear();
+        auto mix_iter {std::begin(voice_pool_mix_positions)};
+        auto loop_iter {std::begin(loop_ranges)};
+        for (unsigned int i {0}; i < pipeline.size();) {
+            if (loop_iter != std::end(loop_ranges) && std::get<0>(*loop_iter) == i) {
+                auto last {std::get<1>(*loop_iter)};
+                plan.push_back({i, last - i + 1, true});
+                i = last + 1;
+                ++loop_iter;
+                continue;
+            }
+
+            step_group group {i, 1};
+            auto const& first {pipeline[i]};
+            auto lanes {generator_implementations[first.generator_type].lanes};
+
+            while (mix_iter != std::end(voice_pool_mix_positions) && std::get<0>(*mix_iter) < i) {
+                ++mix_iter;
+            }
+            auto group_end_limit {mix_iter != std::end(voice_pool_mix_positions) ? std::get<0>(*mix_iter) : UINT_MAX};
+            auto next_loop {loop_iter != std::end(loop_ranges) ? std::get<0>(*loop_iter) : UINT_MAX};
+
+            if (lanes > 0 && first.rate == step_rate::audio && first.oversampling == 1) {
+                for (auto next {i + 1}; next < pipeline.size() && next < next_loop && group.step_count < lanes && i + group.step_count <= group_end_limit; ++next) {
+                    auto const& candidate {pipeline[next]};
+                    if (candidate.generator_type != first.generator_type || candidate.state_offset != first.state_offset || candidate.rate != first.rate || candidate.oversampling != 1) {
+                        break;
+                    }
+                    auto independent {true};
+                    for (auto member {i}; member < next && independent; ++member) {
+                        independent = step_independent_of(next, member);
+                    }
+                    if (!independent) {
+                        break;
+                    }
+                    group.step_count += 1;
+                }
+            }
+
+            plan.push_back(group);
+            i += group.step_count;
+        }
+
+        auto lanes_needed {1u};
+        for (auto const& group : plan) {
+            if (!group.per_sample) {
+                lanes_needed = std::max(lanes_needed, group.step_count);
+            }
+        }
+        ramp_values.resize(lanes_needed * max_inputs * audio_conf.buffer_size);
+        bus_constants.resize(max_inputs * BUS_CHUNK_SIZE);
+
+        resolve_loop_back_inputs();
+        resolve_latencies();
+        resolve_planned_positions();
+        plan_dirty = false;
+    }
+
+    void resolve_planned_positions() {
+        planned_positions.clear();
+        for (unsigned int i {0}; i < pipeline.size(); ++i) {
+            planned_positions.push_back({{pipeline[i].generator_type, pipeline[i].state_index}, i});
+        }
+        std::sort(std::begin(planned_positions), std::end(planned_positions));
+    }
+
+    unsigned int get_planned_generator_position(audio_pipeline::generator_handle ghandle) const {
+        auto iter {std::lower_bound(std::begin(planned_positions), std::end(planned_positions), ghandle, [](std::tuple<audio_pipeline::generator_handle, unsigned int> const& entry, audio_pipeline::generator_handle const& handle) {
+            return std::get<0>(entry) < handle;
+        })};
+        return iter != std::end(planned_positions) && std::get<0>(*iter) == ghandle ? std::get<1>(*iter) : UINT_MAX;
+    }
+
+    // Control rate steps sample too sparsely to be lined up.
+    void resolve_latencies() {
+        buffer_latencies.assign(buffers.size(), 0);
+        auto mix_iter {std::begin(voice_pool_mix_positions)};
+        for (unsigned int i {0}; i < pipeline.size(); ++i) {
+            auto const& step {pipeline[i]};
+            unsigned int input_latency {0};
+            for (unsigned int in {0}; in < step.inputs; ++in) {
+                auto const& inparam {pipeline[i].input_params[in]};
+                if (inparam.is_buffer) {
+                    input_latency = std::max(input_latency, buffer_latencies[inparam.buffer_id]);
+                }
+            }
+
+            for (auto& inparam : pipeline[i].input_params) {
+                auto delay {0u};
+                if (inparam.is_buffer && step.rate == step_rate::audio) {
+                    delay = input_latency - buffer_latencies[inparam.buffer_id];
+                }
+                if (delay != inparam.delay || (delay > 0 && inparam.delay_line.size() != delay + audio_conf.buffer_size)) {
+                    inparam.delay = delay;
+                    inparam.delay_line.assign(delay > 0 ? delay + audio_conf.buffer_size : 0, 0.0f);
+                }
+            }
+
+            auto output_latency {input_latency + generator_implementations[step.generator_type].capabilities.latency};
+            for (unsigned int out {0}; out < step.outputs; ++out) {
+                auto buffer_id {pipeline[i].output_params[out].buffer_id};
+                if (buffer_id < buffer_latencies.size()) {
+                    buffer_latencies[buffer_id] = output_latency;
+                }
+            }
+
+            for (; mix_iter != std::end(voice_pool_mix_positions) && std::get<0>(*mix_iter) <= i; ++mix_iter) {
+                auto const& pool {voice_pools[std::get<1>(*mix_iter)]};
+                unsigned int mix_latency {0};
+                for (auto const& v : pool.voices) {
+                    mix_latency = std::max(mix_latency, buffer_latencies[v.output]);
+                }
+                buffer_latencies[pool.mix_buffer] = mix_latency;
+            }
+        }
+    }
+
+    bool step_is_sounding(pipeline_step const& step) const {
+        return step.voice_pool == UINT_MAX || voice_pools[step.voice_pool].voices[step.voice].active;
+    }
+
+    // A range starting at sample zero starts a new block.
+    void track_written_range(unsigned int buffer_id, unsigned int first_sample, unsigned int end_sample) {
+        auto const& buffer {buffers[buffer_id]};
+        auto& flags {buffers_flags[buffer_id]};
+        if (first_sample == 0) {
+            flags = {true, buffer[0]};
+        }
+        if (!flags.constant) {
+            return;
+        }
+        unsigned int mismatches {0};
+        for (auto i {first_sample}; i < end_sample; ++i) {
+            mismatches += buffer[i] != flags.value;
+        }
+        flags.constant = mismatches == 0;
+    }
+
+    // Delayed inputs keep a step running, their delay line has to move.
+    bool step_is_dormant(unsigned int step_position) {
+        auto& step {pipeline[step_position]};
+        auto is_idle {generator_implementations[step.generator_type].generator_impl.is_idle};
+        auto tail_length {generator_implementations[step.generator_type].capabilities.tail_length};
+        if ((!is_idle || step.lane != UINT_MAX) && tail_length == UINT_MAX) {
+            return false;
+        }
+
+        auto inputs {input_scratch.data()};
+        auto silent {step.inputs > 0};
+        for (unsigned int in {0}; in < step.inputs; ++in) {
+            auto const& inparam {pipeline[step_position].input_params[in]};
+            if (inparam.is_buffer && inparam.delay == 0 && readable_buffer_flags(inparam.buffer_id).constant) {
+                inputs[in] = readable_buffer_flags(inparam.buffer_id).value;
+            } else if (!inparam.is_buffer && !inparam.is_ramping()) {
+                inputs[in] = inparam.value;
+            } else {
+                step.silent_input_samples = 0;
+                return false;
+            }
+            silent = silent && inputs[in] == 0.0f;
+        }
+
+        if (tail_length != UINT_MAX) {
+            auto silent_before {step.silent_input_samples};
+            step.silent_input_samples = silent ? std::min(silent_before, UINT_MAX - audio_conf.buffer_size) + audio_conf.buffer_size : 0;
+            if (silent && silent_before >= tail_length) {
+                return true;
+            }
+        }
+        if (!is_idle || step.lane != UINT_MAX) {
+            return false;
+        }
+
+        auto state {static_cast<void*>(&generator_states[step.generator_type][step.state_offset])};
+        return is_idle(inputs, state);
+    }
+
+    void silence_step_outputs(unsigned int step_position) {
+        for (unsigned int out {0}; out < pipeline[step_position].outputs; ++out) {
+            auto buffer_id {pipeline[step_position].output_params[out].buffer_id};
+            if (!buffers_flags[buffer_id].silent()) {
+                std::fill(std::begin(buffers[buffer_id]), std::end(buffers[buffer_id]), 0.0f);
+                buffers_flags[buffer_id] = {true, 0.0f};
+            }
+        }
+    }
+
+    void mix_voice_pool(voice_pool& pool) {
+        auto& mix {buffers[pool.mix_buffer]};
+        std::fill(std::begin(mix), std::end(mix), 0.0f);
+        for (auto& v : pool.voices) {
+            if (!v.active) {
+                continue;
+            }
+            auto const& output {buffers[v.output]};
+            auto peak {0.0f};
+            for (unsigned int i {0}; i < audio_conf.buffer_size; ++i) {
+                mix[i] += output[i];
+                peak = std::max(peak, std::fabs(output[i]));
+            }
+            v.peak = peak;
+            if (!v.held && peak < VOICE_SILENCE_THRESHOLD) {
+                v.active = false;
+            }
+        }
+        track_written_range(pool.mix_buffer, 0, audio_conf.buffer_size);
+    }
+
+    unsigned int allocate_voice(voice_pool const& pool) const {
+        for (unsigned int i {0}; i < pool.voices.size(); ++i) {
+            if (!pool.voices[i].active) {
+                return i;
+            }
+        }
+        auto stolen_iter {std::min_element(std::begin(pool.voices), std::end(pool.voices), [&](voice const& a, voice const& b) {
+            if (pool.policy == audio_pipeline::voice_steal_policy::quietest) {
+                return a.peak < b.peak;
+            }
+            return a.started < b.started;
+        })};
+        return std::distance(std::begin(pool.voices), stolen_iter);
+    }
+
+    // A stride of zero repeats a constant.
+    void resolve_input_source(generator_input_param& inparam, float* ramp_block, unsigned int first_sample, unsigned int end_sample, float const*& source, unsigned int& stride) {
+        if (inparam.is_buffer && inparam.loop_back) {
+            source = first_sample == 0 ? &inparam.loop_carry : &buffers[inparam.buffer_id][first_sample - 1];
+            stride = 0;
+        } else if (inparam.is_buffer && inparam.delay > 0) {
+            auto& line {inparam.delay_line};
+            if (first_sample == 0) {
+                std::copy(std::begin(line) + audio_conf.buffer_size, std::end(line), std::begin(line));
+            }
+            auto const& buffer {readable_buffer(inparam.buffer_id)};
+            std::copy(&buffer[0] + first_sample, &buffer[0] + end_sample, &line[inparam.delay + first_sample]);
+            source = &line[0];
+            stride = 1;
+        } else if (inparam.is_buffer) {
+            source = &readable_buffer(inparam.buffer_id)[0];
+            stride = 1;
+        } else if (inparam.is_ramping()) {
+            render_ramp(inparam, ramp_block + first_sample, end_sample - first_sample);
+            source = ramp_block;
+            stride = 1;
+        } else {
+            source = &inparam.value;
+            stride = 0;
+        }
+    }
+
+    unsigned int step_input_rate(pipeline_step const& step) const {
+        return step.rate == step_rate::audio ? audio_conf.sample_rate : audio_conf.sample_rate / control_block_size;
+    }
+
+    unsigned int step_sample_rate(pipeline_step const& step) const {
+        return step.rate == step_rate::audio ? audio_conf.sample_rate * step.oversampling : step_input_rate(step);
+    }
+
+    // Returns the position past the events of the loop.
+    unsigned int render_feedback_loop(step_group const& group, unsigned int first_event) {
+        auto group_end {group.first_step + group.step_count};
+        auto event_end {first_event};
+        loop_event_cursors.assign(group.step_count, UINT_MAX);
+        for (; event_end < block_events.size() && block_events[event_end].step_position < group_end; ++event_end) {
+            auto& cursor {loop_event_cursors[block_events[event_end].step_position - group.first_step]};
+            cursor = std::min(cursor, event_end);
+        }
+
+        for (unsigned int sample_id {0}; sample_id < audio_conf.buffer_size; ++sample_id) {
+            for (auto i {group.first_step}; i < group_end; ++i) {
+                auto& cursor {loop_event_cursors[i - group.first_step]};
+                for (; cursor < event_end && block_events[cursor].step_position == i && block_events[cursor].sample_offset <= sample_id; ++cursor) {
+                    pipeline[i].input_params[block_events[cursor].input_id].set_value(block_events[cursor].value);
+                }
+                if (step_is_sounding(pipeline[i])) {
+                    render_step(i, sample_id, sample_id + 1);
+                }
+            }
+        }
+
+        for (auto i {group.first_step}; i < group_end; ++i) {
+            if (!step_is_sounding(pipeline[i])) {
+                skipped_step_count += 1;
+            }
+            for (auto& inparam : pipeline[i].input_params) {
+                if (inparam.loop_back) {
+                    inparam.loop_carry = buffers[inparam.buffer_id][audio_conf.buffer_size - 1];
+                }
+            }
+        }
+        return event_end;
+    }
+
+    void render_step(unsigned int step_position, unsigned int first_sample, unsigned int end_sample) {
+        if (pipeline[step_position].rate != step_rate::audio) {
+            render_control_step(step_position, first_sample, end_sample);
+        } else {
+            render_samples(step_position, first_sample, end_sample);
+        }
+    }
+
+    void render_control_step(unsigned int step_position, unsigned int first_sample, unsigned int end_sample) {
+        auto const& step {pipeline[step_position]};
+        auto linear {step.rate == step_rate::control_linear};
+        auto ramp_scale {1.0f / static_cast<float>(control_block_size)};
+
+        for (auto sample_id {first_sample}; sample_id < end_sample;) {
+            auto control_block_start {sample_id - sample_id % control_block_size};
+            auto control_block_end {std::min(end_sample, control_block_start + control_block_size)};
+
+            if (sample_id == control_block_start) {
+                render_samples(step_position, sample_id, sample_id + 1);
+                for (unsigned int out {0}; out < step.outputs; ++out) {
+                    auto& outparam {pipeline[step_position].output_params[out]};
+                    outparam.control_from = outparam.control_to;
+                    outparam.control_to = buffers[outparam.buffer_id][sample_id];
+                }
+            }
+
+            for (unsigned int out {0}; out < step.outputs; ++out) {
+                auto const& outparam {pipeline[step_position].output_params[out]};
+                auto& buffer {buffers[outparam.buffer_id]};
+                if (linear) {
+                    auto slope {(outparam.control_to - outparam.control_from) * ramp_scale};
+                    for (auto i {sample_id}; i < control_block_end; ++i) {
+                        buffer[i] = outparam.control_from + slope * static_cast<float>(i - control_block_start + 1);
+                    }
+                } else {
+                    std::fill(&buffer[sample_id], &buffer[0] + control_block_end, outparam.control_to);
+                }
+            }
+
+            sample_id = control_block_end;
+        }
+
+        for (unsigned int out {0}; out < step.outputs; ++out) {
+            track_written_range(pipeline[step_position].output_params[out].buffer_id, first_sample, end_sample);
+        }
+    }
+
+    void render_samples(unsigned int step_position, unsigned int first_sample, unsigned int end_sample) {
+        if (pipeline[step_position].oversampling > 1 && pipeline[step_position].rate == step_rate::audio) {
+            render_oversampled_samples(step_position, first_sample, end_sample);
+            return;
+        }
+        if (pipeline[step_position].lane != UINT_MAX) {
+            render_lanes(&step_position, 1, first_sample, end_sample);
+            return;
+        }
+        if (generator_implementations[pipeline[step_position].generator_type].bus_sources > 0) {
+            render_bus(step_position, first_sample, end_sample);
+            return;
+        }
+
+        auto inputs {input_scratch.data()};
+        auto outputs {output_scratch.data()};
+        auto input_sources {source_scratch.data()};
+        auto input_strides {stride_scratch.data()};
+
+        auto& step {pipeline[step_position]};
+        auto const& generator_impl {generator_implementations[step.generator_type]};
+        auto state {static_cast<void*>(&generator_states[step.generator_type][step.state_offset])};
+        auto sample_rate {step_sample_rate(step)};
+
+        for (unsigned int in {0}; in < step.inputs; ++in) {
+            auto ramp_block {&ramp_values[in * audio_conf.buffer_size]};
+            resolve_input_source(pipeline[step_position].input_params[in], ramp_block, first_sample, end_sample, input_sources[in], input_strides[in]);
+        }
+
+        for (unsigned int sample_id {first_sample}; sample_id < end_sample; ++sample_id) {
+            for (unsigned int in {0}; in < step.inputs; ++in) {
+                inputs[in] = input_sources[in][sample_id * input_strides[in]];
+            }
+
+            generator_impl.run(inputs, outputs, state, sample_rate);
+
+            for (unsigned int out {0}; out < step.outputs; ++out) {
+                auto& outparam {pipeline[step_position].output_params[out]};
+                buffers[outparam.buffer_id][sample_id] = outputs[out];
+            }
+        }
+
+        for (unsigned int out {0}; out < step.outputs; ++out) {
+            track_written_range(pipeline[step_position].output_params[out].buffer_id, first_sample, end_sample);
+        }
+    }
+
+    // Sums stay in registers per chunk, so the output may also be a source.
+    void render_bus(unsigned int step_position, unsigned int first_sample, unsigned int end_sample) {
+        auto& step {pipeline[step_position]};
+        auto sources {source_scratch.data()};
+        auto strides {stride_scratch.data()};
+        for (unsigned int in {0}; in < step.inputs; ++in) {
+            resolve_input_source(step.input_params[in], &ramp_values[in * audio_conf.buffer_size], first_sample, end_sample, sources[in], strides[in]);
+            if (strides[in] == 0) {
+                auto chunk {&bus_constants[in * BUS_CHUNK_SIZE]};
+                std::fill(chunk, chunk + BUS_CHUNK_SIZE, sources[in][0]);
+                sources[in] = chunk;
+            }
+        }
+
+        auto buffer_id {step.output_params[0].buffer_id};
+        auto output {buffers[buffer_id].data()};
+        auto sample {first_sample};
+        for (; sample + BUS_CHUNK_SIZE <= end_sample; sample += BUS_CHUNK_SIZE) {
+            float sums[BUS_CHUNK_SIZE] {};
+            for (unsigned int in {0}; in < step.inputs; in += 2) {
+                auto source {sources[in] + sample * strides[in]};
+                auto gain {sources[in + 1] + sample * strides[in + 1]};
+                for (unsigned int i {0}; i < BUS_CHUNK_SIZE; ++i) {
+                    sums[i] += source[i] * gain[i];
+                }
+            }
+            std::copy(sums, sums + BUS_CHUNK_SIZE, output + sample);
+        }
+        for (; sample < end_sample; ++sample) {
+            auto sum {0.0f};
+            for (unsigned int in {0}; in < step.inputs; in += 2) {
+                sum += sources[in][sample * strides[in]] * sources[in + 1][sample * strides[in + 1]];
+            }
+            output[sample] = sum;
+        }
+        track_written_range(buffer_id, first_sample, end_sample);
+    }
+
+    // Steps without outputs are always kept.
+    std::vector<bool> find_live_steps(std::vector<audio_pipeline::buffer_handle> const& live_buffers) const {
+        auto writers {find_buffer_writers()};
+        std::vector<bool> buffer_live(buffers.size(), false);
+        std::vector<audio_pipeline::buffer_handle> worklist {};
+        auto mark_live {[&](audio_pipeline::buffer_handle handle) {
+            if (handle < buffer_live.size() && !buffer_live[handle]) {
+                buffer_live[handle] = true;
+                worklist.push_back(handle);
+            }
+        }};
+
+        std::vector<bool> step_live(pipeline.size(), false);
+        auto mark_step_live {[&](unsigned int step_position) {
+            step_live[step_position] = true;
+            for (auto const& inparam : pipeline[step_position].input_params) {
+                if (inparam.is_buffer) {
+                    mark_live(inparam.buffer_id);
+                }
+            }
+        }};
+
+        for (auto handle : live_buffers) {
+            mark_live(handle);
+        }
+        for (unsigned int i {0}; i < pipeline.size(); ++i) {
+            if (pipeline[i].outputs == 0) {
+                mark_step_live(i);
+            }
+        }
+        while (!worklist.empty()) {
+            auto handle {worklist.back()};
+            worklist.pop_back();
+            for (auto const& pool : voice_pools) {
+                if (pool.mix_buffer != handle) {
+                    continue;
+                }
+                for (auto const& v : pool.voices) {
+                    mark_live(v.output);
+                }
+            }
+            for (auto writer : writers[handle]) {
+                if (!step_live[writer]) {
+                    mark_step_live(writer);
+                }
+            }
+        }
+        return step_live;
+    }
+
+    std::vector<std::vector<unsigned int>> find_buffer_writers() const {
+        std::vector<std::vector<unsigned int>> writers(buffers.size());
+        for (unsigned int i {0}; i < pipeline.size(); ++i) {
+            for (auto const& outparam : pipeline[i].output_params) {
+                auto buffer_id {outparam.buffer_id};
+                if (buffer_id < writers.size() && (writers[buffer_id].empty() || writers[buffer_id].back() != i)) {
+                    writers[buffer_id].push_back(i);
+                }
+            }
+        }
+        return writers;
+    }
+
+    std::set<audio_pipeline::generator_handle> find_generators_with_events() const {
+        std::set<audio_pipeline::generator_handle> handles {};
+        for (auto const& event : parameter_events) {
+            handles.insert(event.generator);
+        }
+        return handles;
+    }
+
+    bool step_is_foldable(unsigned int step_position, std::vector<bool> const& in_loop, std::vector<std::vector<unsigned int>> const& writers, std::set<audio_pipeline::generator_handle> const& with_events) const {
+        auto const& step {pipeline[step_position]};
+        auto flags {generator_implementations[step.generator_type].capabilities.flags};
+        if (!(flags & AUDIO_GENERATOR_STATELESS) || step.lane != UINT_MAX || step.voice_pool != UINT_MAX || step.outputs == 0) {
+            return false;
+        }
+        if (in_loop[step_position]) {
+            return false;
+        }
+
+        for (unsigned int in {0}; in < step.inputs; ++in) {
+            auto const& inparam {pipeline[step_position].input_params[in]};
+            if (inparam.is_buffer || inparam.is_ramping()) {
+                return false;
+            }
+        }
+        if (with_events.find({step.generator_type, step.state_index}) != with_events.end()) {
+            return false;
+        }
+
+        for (unsigned int out {0}; out < step.outputs; ++out) {
+            auto buffer_id {pipeline[step_position].output_params[out].buffer_id};
+            if (buffer_id >= buffers.size() || buffer_is_feedback(buffer_id) || writers[buffer_id].size() != 1) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Returns the readers, which may have become foldable.
+    std::vector<unsigned int> fold_step(unsigned int step_position, std::vector<std::vector<buffer_access>> const& accesses) {
+        auto inputs {input_scratch.data()};
+        auto outputs {output_scratch.data()};
+
+        auto const& step {pipeline[step_position]};
+        auto state {static_cast<void*>(&generator_states[step.generator_type][step.state_offset])};
+        for (unsigned int in {0}; in < step.inputs; ++in) {
+            inputs[in] = pipeline[step_position].input_params[in].value;
+        }
+
+        generator_implementations[step.generator_type].run(inputs, outputs, state, step_sample_rate(step));
+
+        std::vector<unsigned int> readers {};
+        for (unsigned int out {0}; out < step.outputs; ++out) {
+            auto buffer_id {pipeline[step_position].output_params[out].buffer_id};
+            std::fill(std::begin(buffers[buffer_id]), std::end(buffers[buffer_id]), outputs[out]);
+            buffers_flags[buffer_id] = {true, outputs[out]};
+            for (auto const& access : accesses[buffer_id]) {
+                if (access.write) {
+                    continue;
+                }
+                for (auto& inparam : pipeline[access.step_position].input_params) {
+                    if (inparam.is_buffer && inparam.buffer_id == buffer_id) {
+                        inparam.set_value(outputs[out]);
+                    }
+                }
+                readers.push_back(access.step_position);
+            }
+        }
+        plan_dirty = true;
+        return readers;
+    }
+
+    std::vector<bool> find_pinned_buffers(std::vector<audio_pipeline::buffer_handle> const& live_buffers) const {
+        std::vector<bool> pinned(buffers.size(), false);
+        for (auto handle : live_buffers) {
+            if (handle < pinned.size()) {
+                pinned[handle] = true;
+            }
+        }
+        for (auto const& feedback : feedback_buffers) {
+            pinned[feedback.buffer] = true;
+        }
+        for (auto const& pool : voice_pools) {
+            pinned[pool.mix_buffer] = true;
+            for (auto const& v : pool.voices) {
+                pinned[v.output] = true;
+            }
+        }
+        return pinned;
+    }
+
+    std::vector<std::vector<buffer_access>> find_buffer_accesses() const {
+        std::vector<std::vector<buffer_access>> accesses(buffers.size());
+        for (unsigned int i {0}; i < pipeline.size(); ++i) {
+            for (auto const& inparam : pipeline[i].input_params) {
+                if (inparam.is_buffer && inparam.buffer_id < accesses.size()) {
+                    accesses[inparam.buffer_id].push_back({i, false});
+                }
+            }
+            for (auto const& outparam : pipeline[i].output_params) {
+                if (outparam.buffer_id < accesses.size()) {
+                    accesses[outparam.buffer_id].push_back({i, true});
+                }
+            }
+        }
+        return accesses;
+    }
+
+    bool steps_share_voice(unsigned int step_position, unsigned int other_position) const {
+        return pipeline[step_position].voice_pool == pipeline[other_position].voice_pool && pipeline[step_position].voice == pipeline[other_position].voice;
+    }
+
+    // The output must be written by the step alone and only read further down, within its voice.
+    bool step_reuses_input_buffers(unsigned int step_position, std::vector<bool> const& in_loop, std::vector<bool> const& pinned, std::vector<std::vector<buffer_access>>& accesses) {
+        auto& step {pipeline[step_position]};
+        auto flags {generator_implementations[step.generator_type].capabilities.flags};
+        if (!(flags & AUDIO_GENERATOR_IN_PLACE) || step.rate != step_rate::audio || step.outputs == 0) {
+            return false;
+        }
+        if (in_loop[step_position]) {
+            return false;
+        }
+
+        auto in_voice {[&](buffer_access const& access) {
+            return steps_share_voice(step_position, access.step_position);
+        }};
+
+        auto output_is_private {[&](unsigned int buffer_id) {
+            if (buffer_id >= buffers.size() || pinned[buffer_id]) {
+                return false;
+            }
+            return std::all_of(std::begin(accesses[buffer_id]), std::end(accesses[buffer_id]), [&](buffer_access const& access) {
+                auto own_write {access.write && access.step_position == step_position};
+                auto later_read {!access.write && access.step_position > step_position};
+                return (own_write || later_read) && in_voice(access);
+            });
+        }};
+
+        auto input_dies_here {[&](unsigned int buffer_id) {
+            if (buffer_id >= buffers.size() || pinned[buffer_id] || step_writes_buffer(step_position, buffer_id)) {
+                return false;
+            }
+            auto const& list {accesses[buffer_id]};
+            if (list.empty() || !list.front().write || list.front().step_position >= step_position || list.back().step_position > step_position) {
+                return false;
+            }
+            return std::all_of(std::begin(list), std::end(list), in_voice);
+        }};
+
+        auto reused {false};
+        for (unsigned int out {0}; out < step.outputs; ++out) {
+            auto output_id {step.output_params[out].buffer_id};
+            if (!output_is_private(output_id)) {
+                continue;
+            }
+
+            for (unsigned int in {0}; in < step.inputs; ++in) {
+                auto const& inparam {step.input_params[in]};
+                if (!inparam.is_buffer || !input_dies_here(inparam.buffer_id)) {
+                    continue;
+                }
+                auto input_id {inparam.buffer_id};
+
+                for (auto const& access : accesses[output_id]) {
+                    for (auto& reader_param : pipeline[access.step_position].input_params) {
+                        if (!access.write && reader_param.is_buffer && reader_param.buffer_id == output_id) {
+                            reader_param.buffer_id = input_id;
+                        }
+                    }
+                }
+                step.output_params[out].buffer_id = input_id;
+
+                for (auto const& access : accesses[output_id]) {
+                    accesses[input_id].push_back(access);
+                }
+                accesses[output_id].clear();
+
+                reused = true;
+                plan_dirty = true;
+                break;
+            }
+        }
+        return reused;
+    }
+
+    // Empty for steps that can not be merged.
+    std::vector<unsigned int> find_step_signature(unsigned int step_position, std::vector<bool> const& in_loop, std::set<audio_pipeline::generator_handle> const& with_events) const {
+        auto const& step {pipeline[step_position]};
+        auto flags {generator_implementations[step.generator_type].capabilities.flags};
+        if (!(flags & AUDIO_GENERATOR_STATELESS) || step.outputs == 0 || in_loop[step_position]) {
+            return {};
+        }
+
+        audio_pipeline::generator_handle handle {step.generator_type, step.state_index};
+        if (with_events.find(handle) != with_events.end()) {
+            return {};
+        }
+        if (step.voice_pool != UINT_MAX) {
+            auto const& triggers {voice_pools[step.voice_pool].voices[step.voice].trigger_inputs};
+            auto has_triggers {std::any_of(std::begin(triggers), std::end(triggers), [&](voice_trigger_input const& trigger) {
+                return trigger.generator == handle;
+            })};
+            if (has_triggers) {
+                return {};
+            }
+        }
+
+        std::vector<unsigned int> signature {step.generator_type, static_cast<unsigned int>(step.rate), step.oversampling, step.voice_pool, step.voice};
+        for (auto const& inparam : step.input_params) {
+            if (inparam.is_ramping()) {
+                return {};
+            }
+            auto bits {inparam.buffer_id};
+            if (!inparam.is_buffer) {
+                std::memcpy(&bits, &inparam.value, sizeof(bits));
+            }
+            signature.push_back(inparam.is_buffer ? 1 : 0);
+            signature.push_back(bits);
+        }
+        return signature;
+    }
+
+    // Nothing from the earlier step up to the later one may write the buffers both read.
+    bool step_duplicates(unsigned int step_position, unsigned int original_position, std::vector<bool> const& pinned, std::vector<std::vector<buffer_access>> const& accesses, std::vector<std::vector<unsigned int>> const& writers) const {
+        auto const& step {pipeline[step_position]};
+        auto const& original {pipeline[original_position]};
+
+        for (auto const& inparam : step.input_params) {
+            if (!inparam.is_buffer || inparam.buffer_id >= buffers.size()) {
+                continue;
+            }
+            auto const& list {writers[inparam.buffer_id]};
+            auto first_write {std::lower_bound(std::begin(list), std::end(list), original_position)};
+            if (first_write != std::end(list) && *first_write < step_position) {
+                return false;
+            }
+        }
+
+        for (unsigned int out {0}; out < step.outputs; ++out) {
+            auto output_id {step.output_params[out].buffer_id};
+            auto original_id {original.output_params[out].buffer_id};
+            if (output_id >= buffers.size() || original_id >= buffers.size() || output_id == original_id || pinned[output_id] || buffer_is_feedback(original_id)) {
+                return false;
+            }
+            auto output_private {std::all_of(std::begin(accesses[output_id]), std::end(accesses[output_id]), [&](buffer_access const& access) {
+                return access.write ? access.step_position == step_position : access.step_position > step_position;
+            })};
+            if (!output_private || writers[original_id].size() != 1) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void alias_step_outputs(unsigned int step_position, unsigned int original_position, std::vector<std::vector<buffer_access>>& accesses) {
+        auto const& step {pipeline[step_position]};
+        for (unsigned int out {0}; out < step.outputs; ++out) {
+            auto output_id {step.output_params[out].buffer_id};
+            auto original_id {pipeline[original_position].output_params[out].buffer_id};
+
+            for (auto const& access : accesses[output_id]) {
+                for (auto& reader_param : pipeline[access.step_position].input_params) {
+                    if (!access.write && reader_param.is_buffer && reader_param.buffer_id == output_id) {
+                        reader_param.buffer_id = original_id;
+                    }
+                }
+            }
+            accesses[output_id].erase(std::remove_if(std::begin(accesses[output_id]), std::end(accesses[output_id]), [](buffer_access const& access) {
+                return !access.write;
+            }), std::end(accesses[output_id]));
+        }
+        plan_dirty = true;
+    }
+
+    void render_oversampled_samples(unsigned int step_position, unsigned int first_sample, unsigned int end_sample) {
+        auto inputs {input_scratch.data()};
+        auto outputs {output_scratch.data()};
+        auto input_sources {source_scratch.data()};
+        auto input_strides {stride_scratch.data()};
+
+        auto& step {pipeline[step_position]};
+        auto& filters {oversampling_states[step.oversampling_state]};
+        auto const& generator_impl {generator_implementations[step.generator_type]};
+        auto state {static_cast<void*>(&generator_states[step.generator_type][step.state_offset])};
+        auto sample_rate {step_sample_rate(step)};
+        auto lanes {step.lane != UINT_MAX ? generator_impl.lanes : 1u};
+        auto lane {step.lane != UINT_MAX ? step.lane : 0u};
+        auto count {end_sample - first_sample};
+        auto oversampled_count {count * step.oversampling};
+        auto block_size {audio_conf.buffer_size * MAX_OVERSAMPLING};
+
+        std::fill(std::begin(input_scratch), std::end(input_scratch), 0.0f);
+
+        for (unsigned int in {0}; in < step.inputs; ++in) {
+            auto ramp_block {&ramp_values[in * audio_conf.buffer_size]};
+            resolve_input_source(pipeline[step_position].input_params[in], ramp_block, first_sample, end_sample, input_sources[in], input_strides[in]);
+            if (input_strides[in] != 0) {
+                auto oversampled {&oversampled_inputs[in * block_size]};
+                filters.inputs[in].upsample(input_sources[in] + first_sample, count, oversampled, &oversampling_work[0]);
+                input_sources[in] = oversampled;
+            }
+        }
+
+        for (unsigned int sample_id {0}; sample_id < oversampled_count; ++sample_id) {
+            for (unsigned int in {0}; in < step.inputs; ++in) {
+                inputs[in * lanes + lane] = input_sources[in][sample_id * input_strides[in]];
+            }
+
+            if (step.lane != UINT_MAX) {
+                generator_impl.run_lanes(inputs, outputs, state, 1u << lane, sample_rate);
+            } else {
+                generator_impl.run(inputs, outputs, state, sample_rate);
+            }
+
+            for (unsigned int out {0}; out < step.outputs; ++out) {
+                oversampled_outputs[out * block_size + sample_id] = outputs[out * lanes + lane];
+            }
+        }
+
+        for (unsigned int out {0}; out < step.outputs; ++out) {
+            auto buffer_id {pipeline[step_position].output_params[out].buffer_id};
+            filters.outputs[out].downsample(&oversampled_outputs[out * block_size], count, &buffers[buffer_id][first_sample], &oversampling_work[0]);
+            track_written_range(buffer_id, first_sample, end_sample);
+        }
+    }
+
+    void resize_oversampling_scratch() {
+        auto block_size {audio_conf.buffer_size * MAX_OVERSAMPLING};
+        oversampled_inputs.resize(max_inputs * block_size);
+        oversampled_outputs.resize(max_outputs * block_size);
+        oversampling_work.resize(oversampler::work_size(audio_conf.buffer_size, MAX_OVERSAMPLING));
+    }
+
+    void release_oversampling_state(pipeline_step& step) {
+        if (step.oversampling_state != UINT_MAX) {
+            oversampling_states_occupied[step.oversampling_state] = false;
+        }
+        step.oversampling = 1;
+        step.oversampling_state = UINT_MAX;
+    }
+
+    void set_step_oversampling(pipeline_step& step, unsigned int factor) {
+        release_oversampling_state(step);
+        if (factor == 1) {
+            return;
+        }
+
+        if (oversampling_work.empty()) {
+            resize_oversampling_scratch();
+        }
+
+        auto free_iter {std::find(std::begin(oversampling_states_occupied), std::end(oversampling_states_occupied), false)};
+        auto index {static_cast<unsigned int>(std::distance(std::begin(oversampling_states_occupied), free_iter))};
+        if (free_iter == std::end(oversampling_states_occupied)) {
+            oversampling_states.push_back({});
+            oversampling_states_occupied.push_back(true);
+        } else {
+            *free_iter = true;
+        }
+
+        auto& filters {oversampling_states[index]};
+        filters.inputs.assign(step.inputs, oversampler{factor});
+        filters.outputs.assign(step.outputs, oversampler{factor});
+        step.oversampling = factor;
+        step.oversampling_state = index;
+    }
+
+    void render_lanes(unsigned int const* step_positions, unsigned int step_count, unsigned int first_sample, unsigned int end_sample) {
+        auto inputs {input_scratch.data()};
+        auto outputs {output_scratch.data()};
+        auto input_sources {source_scratch.data()};
+        auto input_strides {stride_scratch.data()};
+
+        auto const& first {pipeline[step_positions[0]]};
+        auto const& generator_impl {generator_implementations[first.generator_type]};
+        auto lanes {generator_impl.lanes};
+        auto block {static_cast<void*>(&generator_states[first.generator_type][first.state_offset])};
+        auto sample_rate {step_sample_rate(first)};
+
+        std::fill(std::begin(input_scratch), std::end(input_scratch), 0.0f);
+
+        unsigned int lane_mask {0};
+        for (unsigned int k {0}; k < step_count; ++k) {
+            auto const& step {pipeline[step_positions[k]]};
+            lane_mask |= 1u << step.lane;
+            for (unsigned int in {0}; in < step.inputs; ++in) {
+                auto port {k * max_inputs + in};
+                resolve_input_source(pipeline[step_positions[k]].input_params[in], &ramp_values[port * audio_conf.buffer_size], first_sample, end_sample, input_sources[port], input_strides[port]);
+            }
+        }
+
+        for (unsigned int sample_id {first_sample}; sample_id < end_sample; ++sample_id) {
+            for (unsigned int k {0}; k < step_count; ++k) {
+                auto const& step {pipeline[step_positions[k]]};
+                for (unsigned int in {0}; in < step.inputs; ++in) {
+                    auto port {k * max_inputs + in};
+                    inputs[in * lanes + step.lane] = input_sources[port][sample_id * input_strides[port]];
+                }
+            }
+
+            generator_impl.run_lanes(inputs, outputs, block, lane_mask, sample_rate);
+
+            for (unsigned int k {0}; k < step_count; ++k) {
+                auto const& step {pipeline[step_positions[k]]};
+                for (unsigned int out {0}; out < step.outputs; ++out) {
+                    auto& outparam {pipeline[step_positions[k]].output_params[out]};
+                    buffers[outparam.buffer_id][sample_id] = outputs[out * lanes + step.lane];
+                }
+            }
+        }
+
+        for (unsigned int k {0}; k < step_count; ++k) {
+            for (unsigned int out {0}; out < pipeline[step_positions[k]].outputs; ++out) {
+                track_written_range(pipeline[step_positions[k]].output_params[out].buffer_id, first_sample, end_sample);
+            }
+        }
+    }
+};
+
+audio_pipeline::audio_pipeline(audio_config const& config) : internal{new audio_pipeline::impl} {
+    internal->audio_conf = config;
+    internal->pipeline.reserve(1024);
+    internal->parameter_events.reserve(RESERVED_EVENTS);
+    internal->block_events.reserve(RESERVED_EVENTS);
+}
+
+audio_pipeline::audio_pipeline(audio_pipeline&& other) : internal{other.internal} {
+    other.internal = nullptr;
+}
+
+audio_pipeline& audio_pipeline::operator=(audio_pipeline&& other) {
+    std::swap(internal, other.internal);
+    return *this;
+}
+
+audio_pipeline::~audio_pipeline() {
+    delete internal;
+}
+
+audio_pipeline::generator_type_handle audio_pipeline::add_generator_type(std::string const& generator_code) {
+    return internal->add_generator_type(audio_generator_impl {generator_code});
+}
+
+std::vector<std::shared_ptr<audio_pipeline::compiled_generator_type>> audio_pipeline::compile_generator_types(std::vector<std::string> const& generator_codes) {
+    std::vector<std::shared_ptr<compiled_generator_type>> compiled(generator_codes.size());
+    for (unsigned int i {0}; i < generator_codes.size(); ++i) {
+        auto type {std::make_shared<compiled_generator_type>(generator_codes[i])};
+        if (type->generator.valid()) {
+            compiled[i] = std::move(type);
+        }
+    }
+    return compiled;
+}
+
+bool audio_pipeline::write_generator_object(std::string const& generator_code, std::string const& object_path) {
+    auto source {get_generator_runtime_header() + generator_code};
+    TCCState* tcc_state {tcc_new()};
+    if (!tcc_state) {
+        return false;
+    }
+    tcc_set_output_type(tcc_state, TCC_OUTPUT_OBJ);
+    auto written {tcc_compile_string(tcc_state, source.c_str()) != -1 && tcc_output_file(tcc_state, object_path.c_str()) != -1};
+    tcc_delete(tcc_state);
+    return written;
+}
+
+std::vector<std::shared_ptr<audio_pipeline::compiled_generator_type>> audio_pipeline::load_generator_objects(std::vector<std::string> const& object_paths) {
+    std::vector<std::shared_ptr<compiled_generator_type>> compiled(object_paths.size());
+    for (unsigned int i {0}; i < object_paths.size(); ++i) {
+        auto type {std::make_shared<compiled_generator_type>(load_generator_object(object_paths[i]))};
+        if (type->generator.valid()) {
+            compiled[i] = std::move(type);
+        }
+    }
+    return compiled;
+}
+
+std::string audio_pipeline::get_compiled_generator_id(audio_pipeline::compiled_generator_type const& compiled) {
+    auto const& generator_impl {compiled.generator.generator_impl};
+    return generator_impl.id ? generator_impl.id() : "";
+}
+
+audio_pipeline::generator_type_handle audio_pipeline::add_generator_type(audio_pipeline::compiled_generator_type& compiled) {
+    return internal->add_generator_type(std::move(compiled.generator));
+}
+
+audio_pipeline::generator_type_handle audio_pipeline::add_bus_type(unsigned int sources) {
+    return internal->add_bus_type(sources);
+}
+
+bool audio_pipeline::delete_generator_type(audio_pipeline::generator_type_handle type) {
+    return internal->delete_generator_type(type);
+}
+
+unsigned int audio_pipeline::get_generator_input_count(audio_pipeline::generator_type_handle handle) const {
+    return internal->generator_implementations[handle].inputs;
+}
+
+unsigned int audio_pipeline::get_generator_output_count(audio_pipeline::generator_type_handle handle) const {
+    return internal->generator_implementations[handle].outputs;
+}
+
+bool audio_pipeline::generator_type_is_valid(audio_pipeline::generator_type_handle handle) const {
+    return handle < internal->generator_implementations.size() && internal->generator_implementations[handle].valid();
+}
+
+audio_generator_interface const& audio_pipeline::get_generator_interface(audio_pipeline::generator_type_handle handle) const {
+    return internal->generator_implementations[handle].generator_impl;
+}
+
+audio_pipeline::generator_handle audio_pipeline::add_generator_front(audio_pipeline::generator_type_handle type) {
+    return internal->add_generator(type, 0);
+}
+
+audio_pipeline::generator_handle audio_pipeline::add_generator_before(audio_pipeline::generator_type_handle type, audio_pipeline::generator_handle ghandle) {
+    return internal->add_generator(type, internal->get_generator_position(ghandle));
+}
 
 audio_pipeline::generator_handle audio_pipeline::add_generator_after(audio_pipeline::generator_type_handle type, audio_pipeline::generator_handle ghandle) {
     return internal->add_generator(type, internal->get_generator_position(ghandle) + 1);
@@ -270,6 +2094,57 @@ audio_pipeline::generator_handle audio_pipeline::add_generator_back(audio_pipeli
     return internal->add_generator(type, internal->pipeline.size());
 }
 
+std::vector<audio_pipeline::generator_handle> audio_pipeline::add_generators_back(std::vector<audio_pipeline::step_description> const& steps) {
+    if (!internal->step_descriptions_valid(steps)) {
+        return {};
+    }
+
+    std::vector<generator_handle> handles {};
+    handles.reserve(steps.size());
+    internal->pipeline.reserve(internal->pipeline.size() + steps.size());
+
+    for (auto const& description : steps) {
+        auto slot {internal->allocate_generator_state(description.type)};
+        if (slot.state_index == UINT_MAX) {
+            handles.push_back(INVALID_GENERATOR_HANDLE);
+            continue;
+        }
+        generator_handle handle {description.type, slot.state_index};
+        internal->insert_step(internal->pipeline.size(), description.type, slot.state_index, slot.state_offset, slot.lane);
+        auto& step {internal->pipeline.back()};
+
+        for (unsigned int i {0}; i < step.inputs; ++i) {
+            auto const& binding {description.inputs[i]};
+            auto& param {step.input_params[i]};
+            if (binding.is_buffer) {
+                param.buffer_id = binding.buffer;
+                param.is_buffer = true;
+            } else {
+                param.set_value(binding.is_trigger ? 0.0f : binding.value);
+            }
+            if (binding.is_trigger) {
+                internal->voice_pools[description.voice_pool].voices[description.voice].trigger_inputs.push_back({handle, i, binding.trigger});
+            }
+        }
+        for (unsigned int i {0}; i < step.outputs; ++i) {
+            step.output_params[i].buffer_id = description.outputs[i];
+        }
+
+        if (description.in_voice) {
+            step.voice_pool = description.voice_pool;
+            step.voice = description.voice;
+        }
+        if (description.control_rate) {
+            step.rate = description.interpolation == control_interpolation::linear ? step_rate::control_linear : step_rate::control_hold;
+        }
+        internal->set_step_oversampling(step, description.oversampling);
+        internal->prepare_step(internal->pipeline.size() - 1);
+        handles.push_back(handle);
+    }
+    internal->plan_dirty = true;
+    return handles;
+}
+
 void audio_pipeline::move_generator_front(audio_pipeline::generator_handle handle) {
     internal->move_generator_to_position(handle, 0);
 }
@@ -286,41 +2161,59 @@ void audio_pipeline::move_generator_back(audio_pipeline::generator_handle handle
     internal->move_generator_to_position(handle, internal->pipeline.size());
 }
 
-void audio_pipeline::delete_generator(audio_pipeline::generator_handle handle) {
-    auto generator_position {internal->get_generator_position(handle)};
-    auto generator_type {get_generator_type(handle)};
-    auto const& generator_interface {internal->generator_implementations[generator_type].generator_impl};
-    auto generator_state_index {get_generator_state_index(handle)};
-
-    internal->generator_states_occupied[generator_type][generator_state_index / generator_interface.size()] = false;
+void audio_pipeline::reorder_generators(std::vector<audio_pipeline::generator_handle> const& order) {
+    std::map<generator_handle, unsigned int> ranks {};
+    for (unsigned int i {0}; i < order.size(); ++i) {
+        ranks.insert({order[i], i});
+    }
 
-    auto state_pointer {static_cast<void*>(&internal->generator_states[generator_type][generator_state_index])};
-    generator_interface.deinit(state_pointer);
+    auto& pipeline {internal->pipeline};
+    std::vector<std::tuple<unsigned int, unsigned int>> positions(pipeline.size());
+    for (unsigned int i {0}; i < pipeline.size(); ++i) {
+        auto rank_iter {ranks.find({pipeline[i].generator_type, pipeline[i].state_index})};
+        positions[i] = {rank_iter != ranks.end() ? rank_iter->second : UINT_MAX, i};
+    }
+    std::sort(std::begin(positions), std::end(positions));
 
-    auto pipeline_new_end_iter {std::remove_if(std::begin(internal->pipeline), std::end(internal->pipeline), [&](pipeline_step const& step) {
-        return step.generator_type == generator_type && step.state_index == generator_state_index;
-    })};
-    internal->pipeline.erase(pipeline_new_end_iter, std::end(internal->pipeline));
+    std::vector<pipeline_step> reordered {};
+    reordered.reserve(pipeline.size());
+    for (auto const& position : positions) {
+        reordered.push_back(std::move(pipeline[std::get<1>(position)]));
+    }
+    pipeline = std::move(reordered);
+    internal->plan_dirty = true;
+}
 
-    for (auto& inputs : internal->pipeline_inputs) {
-        inputs.erase(std::begin(inputs) + generator_position);
+void audio_pipeline::delete_generator(audio_pipeline::generator_handle handle) {
+    if (!internal->release_generator(handle)) {
+        return;
     }
-    for (auto& outputs : internal->pipeline_outputs) {
-        outputs.erase(std::begin(outputs) + generator_position);
+
+    auto generator_position {internal->get_generator_position(handle)};
+    if (generator_position == UINT_MAX) {
+        internal->remove_generator_bindings({handle});
+        return;
     }
+    internal->release_oversampling_state(internal->pipeline[generator_position]);
+    std::vector<bool> removed(internal->pipeline.size(), false);
+    removed[generator_position] = true;
+    internal->remove_steps_from_feedback_loops(removed);
+    internal->remove_generator_bindings({handle});
+    internal->pipeline.erase(std::begin(internal->pipeline) + generator_position);
+    internal->plan_dirty = true;
 }
 
 audio_pipeline::buffer_handle audio_pipeline::add_buffer() {
-    for (unsigned int i {0}; i < internal->buffers_occupied.size(); ++i) {
-        if (!internal->buffers_occupied[i]) {
-            internal->buffers_occupied[i] = true;
-            return i;
-        }
+    return internal->allocate_buffer();
+}
+
+std::vector<audio_pipeline::buffer_handle> audio_pipeline::add_buffers(unsigned int count) {
+    std::vector<buffer_handle> handles {};
+    handles.reserve(count);
+    while (handles.size() < count) {
+        handles.push_back(internal->allocate_buffer());
     }
-    internal->buffers.push_back(std::vector<float>{});
-    internal->buffers.back().resize(internal->audio_conf.buffer_size);
-    internal->buffers_occupied.push_back(true);
-    return internal->buffers.size() - 1;
+    return handles;
 }
 
 std::vector<float> const& audio_pipeline::get_buffer(audio_pipeline::buffer_handle handle) const {
@@ -335,97 +2228,513 @@ void audio_pipeline::set_buffer(buffer_handle handle, std::vector<float> const&
     for (unsigned int i {0}; i < buffer.size(); ++i) {
         buffer[i] = new_contents[i];
     }
+    internal->track_written_range(handle, 0, buffer.size());
 }
 
 void audio_pipeline::set_generator_input_value(audio_pipeline::generator_handle ghandle, unsigned int input_id, float value) {
-    if (input_id >= MAX_INPUT_PARAMETERS) {
-        return;
-    }
     for (unsigned int i {0}; i < internal->pipeline.size(); ++i) {
         auto& step {internal->pipeline[i]};
         if (step.state_index == get_generator_state_index(ghandle) && step.generator_type == get_generator_type(ghandle)) {
-            auto& param {internal->pipeline_inputs[input_id][i]};
-            param.value = value;
-            param.is_buffer = false;
+            if (input_id >= step.inputs) {
+                return;
+            }
+            // The plan only depends on which inputs read buffers.
+            auto& param {internal->pipeline[i].input_params[input_id]};
+            if (param.is_buffer) {
+                internal->plan_dirty = true;
+            }
+            param.set_value(value);
             return;
         }
     }
 }
 
-void audio_pipeline::set_generator_input_buffer(audio_pipeline::generator_handle ghandle, unsigned int input_id, audio_pipeline::buffer_handle bhandle) {
-    if (input_id >= MAX_INPUT_PARAMETERS) {
+void audio_pipeline::set_generator_input_ramp(audio_pipeline::generator_handle ghandle, unsigned int input_id, float target, float ramp_time, audio_pipeline::ramp_shape shape) {
+    auto position {internal->get_generator_position(ghandle)};
+    if (position == UINT_MAX || input_id >= internal->pipeline[position].inputs) {
+        return;
+    }
+
+    // Counted at the input rate of the step.
+    auto& param {internal->pipeline[position].input_params[input_id]};
+    auto start {param.is_buffer ? target : param.value};
+    auto sample_rate {internal->step_input_rate(internal->pipeline[position])};
+    auto ramp_samples {static_cast<unsigned int>(std::max(ramp_time, 0.0f) * sample_rate)};
+    if (param.is_buffer) {
+        internal->plan_dirty = true;
+    }
+    param.set_value(start);
+    if (ramp_samples == 0 || start == target) {
+        param.value = target;
         return;
     }
+
+    // Exponential ramps only exist between values of the same sign.
+    param.ramp_exponential = shape == ramp_shape::exponential && start * target > 0.0f;
+    if (param.ramp_exponential) {
+        param.ramp_step = std::pow(target / start, 1.0f / static_cast<float>(ramp_samples));
+    } else {
+        param.ramp_step = (target - start) / static_cast<float>(ramp_samples);
+    }
+    param.ramp_target = target;
+    param.ramp_remaining = ramp_samples;
+}
+
+void audio_pipeline::set_generator_input_buffer(audio_pipeline::generator_handle ghandle, unsigned int input_id, audio_pipeline::buffer_handle bhandle) {
     for (unsigned int i {0}; i < internal->pipeline.size(); ++i) {
         auto& step {internal->pipeline[i]};
         if (step.state_index == get_generator_state_index(ghandle) && step.generator_type == get_generator_type(ghandle)) {
-            auto& param {internal->pipeline_inputs[input_id][i]};
+            if (input_id >= step.inputs) {
+                return;
+            }
+            auto& param {internal->pipeline[i].input_params[input_id]};
             param.buffer_id = bhandle;
             param.is_buffer = true;
+            param.ramp_remaining = 0;
+            internal->plan_dirty = true;
             return;
         }
     }
 }
 
 void audio_pipeline::set_generator_output_buffer(audio_pipeline::generator_handle ghandle, unsigned int output_id, audio_pipeline::buffer_handle bhandle) {
-    if (output_id >= MAX_OUTPUT_PARAMETERS) {
-        return;
-    }
     for (unsigned int i {0}; i < internal->pipeline.size(); ++i) {
         auto& step {internal->pipeline[i]};
         if (step.state_index == get_generator_state_index(ghandle) && step.generator_type == get_generator_type(ghandle)) {
-            auto& param {internal->pipeline_outputs[output_id][i]};
+            if (output_id >= step.outputs) {
+                return;
+            }
+            auto& param {internal->pipeline[i].output_params[output_id]};
             param.buffer_id = bhandle;
+            internal->plan_dirty = true;
             return;
         }
     }
 }
 
+void audio_pipeline::schedule_generator_input_value(audio_pipeline::generator_handle ghandle, unsigned int input_id, float value, unsigned int sample_offset) {
+    internal->schedule_parameter_event({sample_offset, ghandle, input_id, value});
+}
+
 void audio_pipeline::delete_buffer(audio_pipeline::buffer_handle handle) {
+    if (handle >= internal->buffers_occupied.size() || !internal->buffers_occupied[handle]) {
+        return;
+    }
     internal->buffers_occupied[handle] = false;
-    for (unsigned int i {0}; i < internal->pipeline.size(); ++i) {
-        for (auto& inputs : internal->pipeline_inputs) {
-            auto& param {inputs[i]};
+    internal->buffers_free.push_back(handle);
+    internal->release_feedback_buffer(handle);
+    for (auto& step : internal->pipeline) {
+        for (auto& param : step.input_params) {
             if (param.is_buffer && param.buffer_id == handle) {
-                param.is_buffer = false;
-                param.value = 0.0f;
+                param.set_value(0.0f);
             }
         }
-        for (auto& outputs : internal->pipeline_outputs) {
-            auto& param {outputs[i]};
-            param.buffer_id = UINT_MAX;
+        for (auto& param : step.output_params) {
+            if (param.buffer_id == handle) {
+                param.buffer_id = UINT_MAX;
+            }
         }
     }
+    internal->plan_dirty = true;
 }
 
-void audio_pipeline::execute() {
-    float inputs[MAX_INPUT_PARAMETERS];
-    float outputs[MAX_OUTPUT_PARAMETERS];
+void audio_pipeline::set_buffer_feedback(audio_pipeline::buffer_handle handle, bool feedback) {
+    if (handle >= internal->buffers_occupied.size() || !internal->buffers_occupied[handle]) {
+        return;
+    }
+    if (feedback && !internal->buffer_is_feedback(handle)) {
+        internal->buffers_feedback[handle] = internal->feedback_buffers.size();
+        internal->feedback_buffers.push_back({handle, std::vector<float>(internal->audio_conf.buffer_size, 0.0f), {true, 0.0f}});
+    } else if (!feedback) {
+        internal->release_feedback_buffer(handle);
+    }
+    internal->plan_dirty = true;
+}
+
+void audio_pipeline::add_feedback_loop(audio_pipeline::generator_handle first, audio_pipeline::generator_handle last) {
+    internal->feedback_loops.push_back({first, last});
+    internal->plan_dirty = true;
+}
+
+void audio_pipeline::delete_feedback_loop(audio_pipeline::generator_handle first) {
+    auto& loops {internal->feedback_loops};
+    loops.erase(std::remove_if(std::begin(loops), std::end(loops), [&](std::tuple<generator_handle, generator_handle> const& loop) {
+        return std::get<0>(loop) == first;
+    }), std::end(loops));
+    internal->plan_dirty = true;
+}
+
+std::vector<audio_pipeline::step_description> audio_pipeline::describe_steps() const {
+    std::map<std::tuple<generator_handle, unsigned int>, voice_trigger> triggers {};
+    for (auto const& pool : internal->voice_pools) {
+        for (auto const& v : pool.voices) {
+            for (auto const& trigger_input : v.trigger_inputs) {
+                triggers[{trigger_input.generator, trigger_input.input_id}] = trigger_input.trigger;
+            }
+        }
+    }
+
+    std::vector<step_description> descriptions(internal->pipeline.size());
     for (unsigned int i {0}; i < internal->pipeline.size(); ++i) {
+        auto const& step {internal->pipeline[i]};
+        auto& description {descriptions[i]};
+        description.type = step.generator_type;
+        for (unsigned int in {0}; in < step.inputs; ++in) {
+            auto const& param {step.input_params[in]};
+            input_binding binding {};
+            binding.is_buffer = param.is_buffer;
+            binding.buffer = param.is_buffer ? param.buffer_id : 0;
+            binding.value = param.is_ramping() ? param.ramp_target : param.value;
+            auto trigger_iter {triggers.find({{step.generator_type, step.state_index}, in})};
+            if (trigger_iter != triggers.end()) {
+                binding.is_trigger = true;
+                binding.trigger = trigger_iter->second;
+            }
+            description.inputs.push_back(binding);
+        }
+        for (unsigned int out {0}; out < step.outputs; ++out) {
+            description.outputs.push_back(step.output_params[out].buffer_id);
+        }
+        description.control_rate = step.rate != step_rate::audio;
+        description.interpolation = step.rate == step_rate::control_linear ? control_interpolation::linear : control_interpolation::hold;
+        description.oversampling = step.oversampling;
+        description.in_voice = step.voice_pool != UINT_MAX;
+        description.voice_pool = description.in_voice ? step.voice_pool : 0;
+        description.voice = description.in_voice ? step.voice : 0;
+    }
+    return descriptions;
+}
 
-        auto& step {internal->pipeline[i]};
-        auto state {static_cast<void*>(&internal->generator_states[step.generator_type][step.state_index])};
+std::vector<std::tuple<unsigned int, unsigned int>> audio_pipeline::get_feedback_loop_positions() const {
+    return internal->find_feedback_loop_positions();
+}
 
-        for (unsigned int sample_id {0}; sample_id < internal->audio_conf.buffer_size; ++sample_id) {
-            for (unsigned int in {0}; in < step.inputs; ++in) {
-                auto& inparam {internal->pipeline_inputs[in][i]};
-                if (inparam.is_buffer) {
-                    inputs[in] = internal->buffers[inparam.buffer_id][sample_id];
-                } else {
-                    inputs[in] = inparam.value;
+audio_pipeline::optimization_report audio_pipeline::optimize(std::vector<audio_pipeline::buffer_handle> const& live_buffers) {
+    optimization_report report {};
+
+    auto step_live {internal->find_live_steps(live_buffers)};
+    std::vector<bool> removed(step_live.size(), false);
+    for (unsigned int i {0}; i < step_live.size(); ++i) {
+        if (!step_live[i]) {
+            auto const& step {internal->pipeline[i]};
+            report.removed_steps.push_back({step.generator_type, step.state_index});
+            removed[i] = true;
+        }
+    }
+    internal->erase_steps(removed);
+
+    // Folded steps stay in place until the pass is done, so positions hold.
+    auto in_loop {internal->find_steps_in_feedback_loops()};
+    auto writers {internal->find_buffer_writers()};
+    auto with_events {internal->find_generators_with_events()};
+    auto accesses {internal->find_buffer_accesses()};
+    std::vector<bool> folded(internal->pipeline.size(), false);
+    std::vector<unsigned int> worklist(internal->pipeline.size());
+    std::iota(std::rbegin(worklist), std::rend(worklist), 0u);
+    while (!worklist.empty()) {
+        auto i {worklist.back()};
+        worklist.pop_back();
+        if (folded[i] || !internal->step_is_foldable(i, in_loop, writers, with_events)) {
+            continue;
+        }
+        for (auto reader : internal->fold_step(i, accesses)) {
+            worklist.push_back(reader);
+        }
+        folded[i] = true;
+        auto const& step {internal->pipeline[i]};
+        report.folded_steps.push_back({step.generator_type, step.state_index});
+    }
+    internal->erase_steps(folded);
+
+    // Runs in pipeline order, merges may give later steps an earlier signature.
+    auto pinned {internal->find_pinned_buffers(live_buffers)};
+    in_loop = internal->find_steps_in_feedback_loops();
+    accesses = internal->find_buffer_accesses();
+    writers = internal->find_buffer_writers();
+    std::map<std::vector<unsigned int>, unsigned int> first_with_signature {};
+    std::vector<bool> merged(internal->pipeline.size(), false);
+    for (unsigned int i {0}; i < internal->pipeline.size(); ++i) {
+        auto signature {internal->find_step_signature(i, in_loop, with_events)};
+        if (signature.empty()) {
+            continue;
+        }
+        auto iter {first_with_signature.find(signature)};
+        if (iter == first_with_signature.end()) {
+            first_with_signature[signature] = i;
+        } else if (internal->step_duplicates(i, iter->second, pinned, accesses, writers)) {
+            internal->alias_step_outputs(i, iter->second, accesses);
+            auto const& step {internal->pipeline[i]};
+            report.merged_steps.push_back({step.generator_type, step.state_index});
+            merged[i] = true;
+        } else {
+            iter->second = i;
+        }
+    }
+    internal->erase_steps(merged);
+
+    in_loop = internal->find_steps_in_feedback_loops();
+    accesses = internal->find_buffer_accesses();
+    for (unsigned int i {0}; i < internal->pipeline.size(); ++i) {
+        if (internal->step_reuses_input_buffers(i, in_loop, pinned, accesses)) {
+            auto const& step {internal->pipeline[i]};
+            report.in_place_steps.push_back({step.generator_type, step.state_index});
+        }
+    }
+
+    return report;
+}
+
+void audio_pipeline::execute() {
+    if (internal->plan_dirty) {
+        internal->rebuild_plan();
+    }
+
+    internal->resolve_block_events();
+    auto event_iter {std::begin(internal->block_events)};
+    auto event_end  {std::end(internal->block_events)};
+
+    auto mix_iter {std::begin(internal->voice_pool_mix_positions)};
+    auto mix_end  {std::end(internal->voice_pool_mix_positions)};
+
+    auto& batched_steps {internal->batched_steps};
+    auto& evented_steps {internal->evented_steps};
+    internal->skipped_step_count = 0;
+
+    internal->swap_feedback_buffers();
+
+    for (auto const& group : internal->plan) {
+        if (group.per_sample) {
+            auto first_event {static_cast<unsigned int>(std::distance(std::begin(internal->block_events), event_iter))};
+            event_iter = std::begin(internal->block_events) + internal->render_feedback_loop(group, first_event);
+
+            auto last_step {group.first_step + group.step_count - 1};
+            for (; mix_iter != mix_end && std::get<0>(*mix_iter) <= last_step; ++mix_iter) {
+                internal->mix_voice_pool(internal->voice_pools[std::get<1>(*mix_iter)]);
+            }
+            continue;
+        }
+
+        batched_steps.clear();
+        evented_steps.clear();
+        for (auto i {group.first_step}; i < group.first_step + group.step_count; ++i) {
+            auto has_events {event_iter != event_end && event_iter->step_position == i};
+            if (has_events) {
+                evented_steps.push_back(i);
+                internal->pipeline[i].silent_input_samples = 0;
+                while (event_iter != event_end && event_iter->step_position == i) {
+                    ++event_iter;
                 }
+            } else if (!internal->step_is_sounding(internal->pipeline[i])) {
+                internal->skipped_step_count += 1;
+            } else if (internal->step_is_dormant(i)) {
+                internal->silence_step_outputs(i);
+                internal->skipped_step_count += 1;
+            } else {
+                batched_steps.push_back(i);
             }
+        }
+
+        if (batched_steps.size() > 1) {
+            internal->render_lanes(batched_steps.data(), batched_steps.size(), 0, internal->audio_conf.buffer_size);
+        } else if (batched_steps.size() == 1) {
+            internal->render_step(batched_steps[0], 0, internal->audio_conf.buffer_size);
+        }
 
-            step.render_func(inputs, outputs, state, internal->audio_conf.sample_rate);
+        // Split the block only where a step has events.
+        for (auto i : evented_steps) {
+            auto sounding {internal->step_is_sounding(internal->pipeline[i])};
+            auto step_event_iter {std::lower_bound(std::begin(internal->block_events), event_iter, i, [](resolved_parameter_event const& event, unsigned int position) {
+                return event.step_position < position;
+            })};
+            unsigned int sample_id {0};
+            for (; step_event_iter != event_iter && step_event_iter->step_position == i; ++step_event_iter) {
+                if (sounding) {
+                    internal->render_step(i, sample_id, step_event_iter->sample_offset);
+                }
+                sample_id = step_event_iter->sample_offset;
 
-            for (unsigned int out {0}; out < step.outputs; ++out) {
-                auto& outparam {internal->pipeline_outputs[out][i]};
-                internal->buffers[outparam.buffer_id][sample_id] = outputs[out];
+                internal->pipeline[i].input_params[step_event_iter->input_id].set_value(step_event_iter->value);
+            }
+            if (sounding) {
+                internal->render_step(i, sample_id, internal->audio_conf.buffer_size);
+            } else {
+                internal->skipped_step_count += 1;
+            }
+        }
+
+        auto last_step {group.first_step + group.step_count - 1};
+        for (; mix_iter != mix_end && std::get<0>(*mix_iter) <= last_step; ++mix_iter) {
+            internal->mix_voice_pool(internal->voice_pools[std::get<1>(*mix_iter)]);
+        }
+    }
+}
+
+audio_pipeline::voice_pool_handle audio_pipeline::add_voice_pool(audio_pipeline::voice_steal_policy policy, audio_pipeline::buffer_handle mix_buffer) {
+    internal->voice_pools.push_back({policy, mix_buffer, {}, 0});
+    internal->plan_dirty = true;
+    return internal->voice_pools.size() - 1;
+}
+
+unsigned int audio_pipeline::add_voice(audio_pipeline::voice_pool_handle pool, audio_pipeline::buffer_handle voice_output) {
+    auto& voices {internal->voice_pools[pool].voices};
+    voices.push_back({voice_output, {}, false, false, 0.0f, 0, 0.0f});
+    return voices.size() - 1;
+}
+
+void audio_pipeline::add_generator_to_voice(audio_pipeline::voice_pool_handle pool, unsigned int voice, audio_pipeline::generator_handle ghandle) {
+    auto position {internal->get_generator_position(ghandle)};
+    if (position == UINT_MAX) {
+        return;
+    }
+    internal->pipeline[position].voice_pool = pool;
+    internal->pipeline[position].voice = voice;
+    internal->plan_dirty = true;
+}
+
+void audio_pipeline::set_voice_trigger_input(audio_pipeline::voice_pool_handle pool, unsigned int voice, audio_pipeline::generator_handle ghandle, unsigned int input_id, audio_pipeline::voice_trigger trigger) {
+    auto position {internal->get_generator_position(ghandle)};
+    if (position == UINT_MAX || input_id >= internal->pipeline[position].inputs) {
+        return;
+    }
+    internal->voice_pools[pool].voices[voice].trigger_inputs.push_back({ghandle, input_id, trigger});
+    set_generator_input_value(ghandle, input_id, 0.0f);
+}
+
+void audio_pipeline::note_on(audio_pipeline::voice_pool_handle pool, float note, float velocity, unsigned int sample_offset) {
+    auto& vpool {internal->voice_pools[pool]};
+    if (vpool.voices.empty()) {
+        return;
+    }
+    auto& v {vpool.voices[internal->allocate_voice(vpool)]};
+    auto retrigger {v.active};
+
+    v.active = true;
+    v.held = true;
+    v.note = note;
+    v.started = ++vpool.note_count;
+
+    for (auto const& trigger_input : v.trigger_inputs) {
+        switch (trigger_input.trigger) {
+        case voice_trigger::note:
+            schedule_generator_input_value(trigger_input.generator, trigger_input.input_id, note, sample_offset);
+            break;
+        case voice_trigger::velocity:
+            schedule_generator_input_value(trigger_input.generator, trigger_input.input_id, velocity, sample_offset);
+            break;
+        case voice_trigger::gate:
+            // A one sample gap in the gate gives envelopes a new attack.
+            if (retrigger) {
+                schedule_generator_input_value(trigger_input.generator, trigger_input.input_id, 0.0f, sample_offset);
+                schedule_generator_input_value(trigger_input.generator, trigger_input.input_id, 1.0f, sample_offset + 1);
+            } else {
+                schedule_generator_input_value(trigger_input.generator, trigger_input.input_id, 1.0f, sample_offset);
+            }
+            break;
+        }
+    }
+}
+
+void audio_pipeline::note_off(audio_pipeline::voice_pool_handle pool, float note, unsigned int sample_offset) {
+    for (auto& v : internal->voice_pools[pool].voices) {
+        if (!v.active || !v.held || v.note != note) {
+            continue;
+        }
+        v.held = false;
+        for (auto const& trigger_input : v.trigger_inputs) {
+            if (trigger_input.trigger == voice_trigger::gate) {
+                schedule_generator_input_value(trigger_input.generator, trigger_input.input_id, 0.0f, sample_offset);
             }
         }
     }
 }
 
+unsigned int audio_pipeline::get_voice_pool_count() const {
+    return internal->voice_pools.size();
+}
+
+void audio_pipeline::set_generator_control_rate(audio_pipeline::generator_handle ghandle, audio_pipeline::control_interpolation interpolation) {
+    auto position {internal->get_generator_position(ghandle)};
+    if (position == UINT_MAX) {
+        return;
+    }
+    internal->pipeline[position].rate = interpolation == control_interpolation::linear ? step_rate::control_linear : step_rate::control_hold;
+    internal->prepare_step(position);
+    internal->plan_dirty = true;
+}
+
+void audio_pipeline::set_generator_audio_rate(audio_pipeline::generator_handle ghandle) {
+    auto position {internal->get_generator_position(ghandle)};
+    if (position == UINT_MAX) {
+        return;
+    }
+    internal->pipeline[position].rate = step_rate::audio;
+    internal->prepare_step(position);
+    internal->plan_dirty = true;
+}
+
+void audio_pipeline::set_generator_oversampling(audio_pipeline::generator_handle ghandle, unsigned int factor) {
+    if (factor != 1 && factor != 2 && factor != 4 && factor != MAX_OVERSAMPLING) {
+        return;
+    }
+    auto position {internal->get_generator_position(ghandle)};
+    if (position == UINT_MAX || (factor != 1 && internal->pipeline[position].rate != step_rate::audio)) {
+        return;
+    }
+    internal->set_step_oversampling(internal->pipeline[position], factor);
+    internal->prepare_step(position);
+    internal->plan_dirty = true;
+}
+
+void audio_pipeline::set_control_block_size(unsigned int samples) {
+    if (samples == 0 || internal->audio_conf.buffer_size % samples != 0) {
+        return;
+    }
+    internal->control_block_size = samples;
+    for (unsigned int i {0}; i < internal->pipeline.size(); ++i) {
+        if (internal->pipeline[i].rate != step_rate::audio) {
+            internal->prepare_step(i);
+        }
+    }
+}
+
+void audio_pipeline::set_audio_config(audio_config const& config) {
+    if (config.buffer_size == 0 || config.sample_rate == 0) {
+        return;
+    }
+    internal->audio_conf = config;
+    internal->control_block_size = std::gcd(internal->control_block_size, config.buffer_size);
+
+    for (auto& buffer : internal->buffers) {
+        buffer.resize(config.buffer_size, 0.0f);
+    }
+    for (auto& flags : internal->buffers_flags) {
+        flags = {false, 0.0f};
+    }
+    for (auto& feedback : internal->feedback_buffers) {
+        feedback.previous.resize(config.buffer_size, 0.0f);
+        feedback.previous_flags = {false, 0.0f};
+    }
+    if (!internal->oversampling_work.empty()) {
+        internal->resize_oversampling_scratch();
+    }
+
+    for (unsigned int i {0}; i < internal->pipeline.size(); ++i) {
+        internal->prepare_step(i);
+    }
+    internal->plan_dirty = true;
+}
+
+unsigned int audio_pipeline::get_buffer_latency(audio_pipeline::buffer_handle handle) {
+    if (internal->plan_dirty) {
+        internal->rebuild_plan();
+    }
+    return handle < internal->buffer_latencies.size() ? internal->buffer_latencies[handle] : 0;
+}
+
+unsigned int audio_pipeline::get_skipped_step_count() const {
+    return internal->skipped_step_count;
+}
+
 unsigned int audio_pipeline::get_length() const {
     return internal->pipeline.size();
 }
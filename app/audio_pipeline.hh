@@ -3,6 +3,7 @@
 #include <vector>
 #include <tuple>
 #include <string>
+#include <memory>
 #include "audio_config.hh"
 #include "audio_generator_interface.hh"
 
@@ -12,31 +13,108 @@ struct audio_pipeline {
     using generator_type_handle = unsigned int;
     using generator_handle      = std::tuple<generator_type_handle, unsigned int>;
     using buffer_handle         = unsigned int;
+    using voice_pool_handle     = unsigned int;
+
+    enum class ramp_shape {
+        linear,
+        exponential
+    };
+
+    enum class voice_steal_policy {
+        oldest,
+        quietest
+    };
+
+    enum class control_interpolation {
+        hold,
+        linear
+    };
+
+    enum class voice_trigger {
+        note,
+        velocity,
+        gate
+    };
+
+    struct optimization_report {
+        std::vector<generator_handle> removed_steps;
+        std::vector<generator_handle> folded_steps;
+        std::vector<generator_handle> merged_steps;
+        std::vector<generator_handle> in_place_steps;
+    };
+
+    // Trigger inputs are set by the notes of the step's voice.
+    struct input_binding {
+        bool          is_buffer {false};
+        buffer_handle buffer {0};
+        float         value {0.0f};
+        bool          is_trigger {false};
+        voice_trigger trigger {voice_trigger::gate};
+    };
+
+    struct step_description {
+        generator_type_handle      type {0};
+        std::vector<input_binding> inputs {};
+        std::vector<buffer_handle> outputs {};
+        bool                       control_rate {false};
+        control_interpolation      interpolation {control_interpolation::hold};
+        unsigned int               oversampling {1};
+        bool                       in_voice {false};
+        voice_pool_handle          voice_pool {0};
+        unsigned int               voice {0};
+    };
 
     audio_pipeline  (audio_config const& config);
     audio_pipeline  (audio_pipeline const& other) = delete;
-    audio_pipeline  (audio_pipeline&& other) = delete;
+    audio_pipeline  (audio_pipeline&& other);
     audio_pipeline& operator= (audio_pipeline const& other) = delete;
-    audio_pipeline& operator= (audio_pipeline&& other) = delete;
+    audio_pipeline& operator= (audio_pipeline&& other);
     ~audio_pipeline ();
 
+    struct compiled_generator_type;
+
     generator_type_handle add_generator_type(std::string const& generator_code);
+
+    // Compiles one code at a time, libtcc keeps its state in globals. Null for failed codes.
+    static std::vector<std::shared_ptr<compiled_generator_type>> compile_generator_types(std::vector<std::string> const& generator_codes);
+    static std::string get_compiled_generator_id(compiled_generator_type const& compiled);
+
+    // Object files written here are linked by load_generator_objects without compiling again.
+    static bool write_generator_object(std::string const& generator_code, std::string const& object_path);
+    static std::vector<std::shared_ptr<compiled_generator_type>> load_generator_objects(std::vector<std::string> const& object_paths);
+
+    // Takes the compiled code over.
+    generator_type_handle add_generator_type(compiled_generator_type& compiled);
     bool generator_type_is_valid(generator_type_handle handle) const;
     audio_generator_interface const& get_generator_interface(generator_type_handle handle) const;
 
+    // Sources at even ports, their gains at the odd ports after them.
+    generator_type_handle add_bus_type(unsigned int sources);
+    unsigned int get_generator_input_count(generator_type_handle handle) const;
+    unsigned int get_generator_output_count(generator_type_handle handle) const;
+
+    // Fails while generators of the type are left.
+    bool delete_generator_type(generator_type_handle type);
+
     generator_handle add_generator_front  (generator_type_handle type);
     generator_handle add_generator_before (generator_type_handle type, generator_handle ghandle);
     generator_handle add_generator_after  (generator_type_handle type, generator_handle ghandle);
     generator_handle add_generator_back   (generator_type_handle type);
 
+    // Adds nothing if any step of the batch is invalid.
+    std::vector<generator_handle> add_generators_back(std::vector<step_description> const& steps);
+
     void move_generator_front  (generator_handle handle);
     void move_generator_before (generator_handle handle, generator_handle other);
     void move_generator_after  (generator_handle handle, generator_handle other);
     void move_generator_back   (generator_handle handle);
 
+    void reorder_generators(std::vector<generator_handle> const& order);
+
     void delete_generator(generator_handle handle);
 
-    buffer_handle add_buffer();
+    buffer_handle              add_buffer();
+    std::vector<buffer_handle> add_buffers(unsigned int count);
 
     std::vector<float> const& get_buffer(buffer_handle handle) const;
     void set_buffer(buffer_handle handle, std::vector<float> const& new_contents);
@@ -45,10 +123,52 @@ struct audio_pipeline {
     void set_generator_input_buffer  (generator_handle ghandle, unsigned int input_id,  buffer_handle bhandle);
     void set_generator_output_buffer (generator_handle ghandle, unsigned int output_id, buffer_handle bhandle);
 
+    void set_generator_input_ramp(generator_handle ghandle, unsigned int input_id, float target, float ramp_time, ramp_shape shape);
+
+    // Offsets past the end of the block carry over to the following blocks.
+    void schedule_generator_input_value(generator_handle ghandle, unsigned int input_id, float value, unsigned int sample_offset);
+
     void delete_buffer(buffer_handle handle);
 
+    // Readers get the value written in the previous block.
+    void set_buffer_feedback(buffer_handle handle, bool feedback);
+
+    // Runs the steps one sample at a time, loops must not overlap.
+    void add_feedback_loop    (generator_handle first, generator_handle last);
+    void delete_feedback_loop (generator_handle first);
+
+    // The control block size must divide the buffer size.
+    void set_generator_control_rate (generator_handle ghandle, control_interpolation interpolation);
+    void set_generator_audio_rate   (generator_handle ghandle);
+    void set_control_block_size     (unsigned int samples);
+
+    void set_audio_config(audio_config const& config);
+
+    // Factors 2, 4 and 8, 1 turns oversampling off.
+    void set_generator_oversampling(generator_handle ghandle, unsigned int factor);
+
+    voice_pool_handle add_voice_pool         (voice_steal_policy policy, buffer_handle mix_buffer);
+    unsigned int      add_voice              (voice_pool_handle pool, buffer_handle voice_output);
+    void              add_generator_to_voice (voice_pool_handle pool, unsigned int voice, generator_handle ghandle);
+    void              set_voice_trigger_input(voice_pool_handle pool, unsigned int voice, generator_handle ghandle, unsigned int input_id, voice_trigger trigger);
+
+    void note_on  (voice_pool_handle pool, float note, float velocity, unsigned int sample_offset);
+    void note_off (voice_pool_handle pool, float note, unsigned int sample_offset);
+    unsigned int get_voice_pool_count() const;
+
+    // Removes dead steps, folds constants, merges duplicates and runs steps in place.
+    optimization_report optimize(std::vector<buffer_handle> const& live_buffers);
+
+    // Builds an optimised pipeline again without optimising it.
+    std::vector<step_description>                       describe_steps() const;
+    std::vector<std::tuple<unsigned int, unsigned int>> get_feedback_loop_positions() const;
+
     void execute();
 
+    unsigned int        get_skipped_step_count() const;
+
+    // Not const, the plan is rebuilt first when steps changed.
+    unsigned int        get_buffer_latency(buffer_handle handle);
     unsigned int        get_length() const;
     audio_config const& get_audio_config() const;
 
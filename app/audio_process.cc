@@ -6,6 +6,8 @@
 #include <limits>
 #include <soundio/soundio.h>
 #include <iterator>
+#include <atomic>
+#include <cstring>
 #include "startup_parameters.hh"
 
 namespace bzzt {
@@ -16,6 +18,16 @@ auto audio_process_instance_count {0};
 auto channel_read_pos {static_cast<unsigned int>(std::numeric_limits<unsigned int>::max())};
 std::vector<float> empty_buffer;
 
+// Input ring capacity in blocks. The renderer keeps the fill level close to one block, the rest is headroom for scheduling jitter.
+const unsigned int INPUT_RING_BLOCKS {8};
+
+// Frames the input ring may run ahead of one block before the renderer starts dropping single frames to follow clock drift.
+const unsigned int INPUT_DRIFT_TOLERANCE {32};
+
+SoundIoBackend get_audio_backend() {
+    return get_audio_backend_name() == "dummy" ? SoundIoBackendDummy : SoundIoBackendAlsa;
+}
+
 }
 
 struct audio_process::impl {
@@ -23,28 +35,75 @@ struct audio_process::impl {
         audio_instance{nullptr},
         audio_device{nullptr},
         audio_stream{nullptr},
-        config{256, 44100},
+        audio_input_device{nullptr},
+        audio_input_stream{nullptr},
+        input_ring{nullptr},
+        input_running{false},
+        input_channel_count{0},
+        input_channels{},
+        output_latency{0.0},
+        input_latency{0.0},
+        config{DEFAULT_AUDIO_CONFIG},
         pipeline{config},
         incoming_configuration_callbacks{},
         incoming_cleanup_callbacks{},
         config_lock{},
+        incoming_notes{},
         buffer_left{},
         buffer_right{},
         buffer_left_valid{false},
-        buffer_right_valid{false} {}
+        buffer_right_valid{false},
+        input_buffer_left{},
+        input_buffer_right{},
+        input_buffer_left_valid{false},
+        input_buffer_right_valid{false},
+        declick_requested{false},
+        crossfading{false},
+        ahead_channels{},
+        played_channels{},
+        played_channels_valid{false} {}
 
     SoundIo* audio_instance;
     SoundIoDevice* audio_device;
     SoundIoOutStream* audio_stream;
+    SoundIoDevice* audio_input_device;
+    SoundIoInStream* audio_input_stream;
+    SoundIoRingBuffer* input_ring;
+
+    // Set once capture has fully started, the renderer leaves the input alone until then.
+    std::atomic<bool> input_running;
+    unsigned int input_channel_count;
+    std::vector<float> input_channels[2];
+    std::atomic<double> output_latency;
+    std::atomic<double> input_latency;
     audio_config config;
     audio_pipeline pipeline;
     std::queue<std::tuple<void*, void (*)(audio_process::configurer&, void*)>> incoming_configuration_callbacks;
     std::queue<std::tuple<void*, void (*)(void*)>> incoming_cleanup_callbacks;
     std::mutex config_lock;
+
+    // Notes played since the last block as note, velocity and on, guarded by config_lock.
+    std::vector<std::tuple<float, float, bool>> incoming_notes;
     audio_pipeline::buffer_handle buffer_left;
     audio_pipeline::buffer_handle buffer_right;
     bool buffer_left_valid;
     bool buffer_right_valid;
+    audio_pipeline::buffer_handle input_buffer_left;
+    audio_pipeline::buffer_handle input_buffer_right;
+    bool input_buffer_left_valid;
+    bool input_buffer_right_valid;
+
+    // Set by configurer::declick for the configurations being applied, and for the block after them.
+    bool declick_requested;
+    bool crossfading;
+
+    // Output of the coming block as the pipeline rendered it before a declicking configuration.
+    std::vector<float> ahead_channels[2];
+
+    // Played instead of the channel buffers while valid: the block rendered before configurations
+    // changed the pipeline, or the block after them crossfaded.
+    std::vector<float> played_channels[2];
+    bool played_channels_valid;
 
     void init() {
         if (!global_audio_enabled()) {
@@ -57,7 +116,7 @@ struct audio_process::impl {
         if (!audio_instance) {
             suicide_violently("soundio_create failed");
         }
-        auto error {soundio_connect_backend(audio_instance, SoundIoBackendAlsa)};
+        auto error {soundio_connect_backend(audio_instance, get_audio_backend())};
         if (error) {
             suicide_violently("soundio_connect failed, " + std::string{ soundio_strerror(error) });
         }
@@ -91,7 +150,74 @@ struct audio_process::impl {
         }
     }
 
+    // Audio input is optional, a capture device that is missing or fails to open leaves the input
+    // channels silent. Returns false in that case.
+    bool init_input() {
+        if (input_running) {
+            return true;
+        }
+        auto device_index {soundio_default_input_device_index(audio_instance)};
+        if (device_index < 0) {
+            return false;
+        }
+        audio_input_device = soundio_get_input_device(audio_instance, device_index);
+        if (!audio_input_device) {
+            return false;
+        }
+        audio_input_stream = soundio_instream_create(audio_input_device);
+        if (!audio_input_stream) {
+            suicide_input();
+            return false;
+        }
+        audio_input_stream->format = SoundIoFormatFloat32NE;
+        audio_input_stream->read_callback = audio_input_callback;
+        audio_input_stream->sample_rate = config.sample_rate;
+        audio_input_stream->software_latency = static_cast<double>(config.buffer_size) / static_cast<double>(config.sample_rate);
+        audio_input_stream->userdata = static_cast<void*>(this);
+        auto error {soundio_instream_open(audio_input_stream)};
+        if (error || audio_input_stream->layout_error) {
+            suicide_input();
+            return false;
+        }
+        input_channel_count = audio_input_stream->layout.channel_count;
+        for (auto& channel : input_channels) {
+            channel.resize(config.buffer_size);
+        }
+        auto capacity {static_cast<int>(INPUT_RING_BLOCKS * config.buffer_size * input_channel_count * sizeof(float))};
+        input_ring = soundio_ring_buffer_create(audio_instance, capacity);
+        if (!input_ring) {
+            suicide_input();
+            return false;
+        }
+        error = soundio_instream_start(audio_input_stream);
+        if (error) {
+            suicide_input();
+            return false;
+        }
+
+        // The renderer reads the ring from here on.
+        input_running = true;
+        return true;
+    }
+
+    void suicide_input() {
+        input_running = false;
+        if (audio_input_stream) {
+            soundio_instream_destroy(audio_input_stream);
+            audio_input_stream = nullptr;
+        }
+        if (audio_input_device) {
+            soundio_device_unref(audio_input_device);
+            audio_input_device = nullptr;
+        }
+        if (input_ring) {
+            soundio_ring_buffer_destroy(input_ring);
+            input_ring = nullptr;
+        }
+    }
+
     void suicide() {
+        suicide_input();
         if (audio_stream) {
             soundio_outstream_destroy(audio_stream);
             audio_stream = nullptr;
@@ -111,12 +237,95 @@ struct audio_process::impl {
         throw audio_exception {message};
     }
 
+    // Moves exactly one block of captured frames from the input ring into the input channel buffers.
+    // The ring is kept close to one block deep: a ring that runs ahead is trimmed (all at once when far
+    // behind, one frame per block when slowly drifting) and a ring that runs dry repeats its last frame.
+    void capture_input() {
+        if (!input_running) {
+            return;
+        }
+
+        auto const frame_bytes {static_cast<int>(input_channel_count * sizeof(float))};
+        auto const block_frames {static_cast<int>(config.buffer_size)};
+        auto fill_frames {soundio_ring_buffer_fill_count(input_ring) / frame_bytes};
+
+        if (fill_frames > 2 * block_frames) {
+            soundio_ring_buffer_advance_read_ptr(input_ring, (fill_frames - block_frames) * frame_bytes);
+            fill_frames = block_frames;
+        } else if (fill_frames > block_frames + static_cast<int>(INPUT_DRIFT_TOLERANCE)) {
+            soundio_ring_buffer_advance_read_ptr(input_ring, frame_bytes);
+            fill_frames -= 1;
+        }
+
+        auto read_frames {std::min(fill_frames, block_frames)};
+        auto frames {reinterpret_cast<float const*>(soundio_ring_buffer_read_ptr(input_ring))};
+        for (unsigned int c {0}; c < 2; ++c) {
+            auto source_channel {std::min(c, input_channel_count - 1)};
+            auto& channel {input_channels[c]};
+            auto held {read_frames > 0 ? frames[(read_frames - 1) * input_channel_count + source_channel] : 0.0f};
+            for (auto i {0}; i < read_frames; ++i) {
+                channel[i] = frames[i * input_channel_count + source_channel];
+            }
+            std::fill(std::begin(channel) + read_frames, std::end(channel), held);
+        }
+        soundio_ring_buffer_advance_read_ptr(input_ring, read_frames * frame_bytes);
+
+        if (input_buffer_left_valid) {
+            pipeline.set_buffer(input_buffer_left, input_channels[0]);
+        }
+        if (input_buffer_right_valid) {
+            pipeline.set_buffer(input_buffer_right, input_channels[1]);
+        }
+    }
+
+    // Renders the coming block with the pipeline as it is and keeps its output, once for all the
+    // configurations of a render.
+    void render_ahead() {
+        if (declick_requested) {
+            return;
+        }
+        pipeline.execute();
+        ahead_channels[0] = get_channel(0);
+        ahead_channels[1] = get_channel(1);
+        declick_requested = true;
+    }
+
+    // Fills played_channels with the output channels crossfaded from ahead_channels across the block.
+    void crossfade_channels() {
+        for (unsigned int c {0}; c < 2; ++c) {
+            auto const& from {ahead_channels[c]};
+            auto const& to {get_channel(c)};
+            auto& played {played_channels[c]};
+            played.resize(to.size());
+            for (unsigned int i {0}; i < to.size(); ++i) {
+                auto gain {static_cast<float>(i + 1) / static_cast<float>(to.size())};
+                auto old_sample {i < from.size() ? from[i] : 0.0f};
+                played[i] = old_sample + (to[i] - old_sample) * gain;
+            }
+        }
+        played_channels_valid = true;
+    }
+
     void render() {
+        capture_input();
         pipeline.execute();
 
+        played_channels_valid = false;
+        if (crossfading) {
+            crossfade_channels();
+            crossfading = false;
+        }
+
         while (!config_lock.try_lock()) {}
         configurer _configurer {this};
 
+        // Configurations may change the pipeline and the output channels, what was rendered before is kept.
+        if (incoming_configuration_callbacks.size() > 0 && !played_channels_valid) {
+            played_channels[0] = get_channel(0);
+            played_channels[1] = get_channel(1);
+            played_channels_valid = true;
+        }
+
         // TODO: Call cleanup callback in a different thread.
         while (incoming_configuration_callbacks.size() > 0) {
             auto& configuration_data {incoming_configuration_callbacks.front()};
@@ -127,9 +336,34 @@ struct audio_process::impl {
             incoming_cleanup_callbacks.pop();
         }
 
+        if (declick_requested) {
+            declick_requested = false;
+            crossfading = true;
+        }
+
+        // Notes come after the configurations, so a block rendered ahead does not take their events.
+        for (auto const& note : incoming_notes) {
+            for (audio_pipeline::voice_pool_handle pool {0}; pool < pipeline.get_voice_pool_count(); ++pool) {
+                if (std::get<2>(note)) {
+                    pipeline.note_on(pool, std::get<0>(note), std::get<1>(note), 0);
+                } else {
+                    pipeline.note_off(pool, std::get<0>(note), 0);
+                }
+            }
+        }
+        incoming_notes.clear();
+
         config_lock.unlock();
     }
 
+    // What gets played, the channel buffers unless played_channels stand in for them.
+    std::vector<float> const& get_output_channel(unsigned int index) const {
+        if (played_channels_valid && index < 2) {
+            return played_channels[index];
+        }
+        return get_channel(index);
+    }
+
     std::vector<float> const& get_channel(unsigned int index) const {
         if (index == 0 && buffer_left_valid) {
             return pipeline.get_buffer(buffer_left);
@@ -144,6 +378,15 @@ struct audio_process::impl {
         return config;
     }
 
+    double get_round_trip_latency() const {
+        auto ring_frames {0};
+        if (input_running) {
+            ring_frames = soundio_ring_buffer_fill_count(input_ring) / static_cast<int>(input_channel_count * sizeof(float));
+        }
+        auto block_latency {static_cast<double>(config.buffer_size + ring_frames) / static_cast<double>(config.sample_rate)};
+        return input_latency + block_latency + output_latency;
+    }
+
 private:
     static void audio_callback(SoundIoOutStream* stream, int frame_count_min, int frame_count_max) {
         (void) frame_count_max;
@@ -172,7 +415,7 @@ private:
                 }
                 for (auto c {0}; c < layout->channel_count; ++c) {
                     auto ptr {(float*)(areas[c].ptr + areas[c].step * i)};
-                    *ptr = renderer->get_channel(c)[channel_read_pos];
+                    *ptr = renderer->get_output_channel(c)[channel_read_pos];
                 }
                 channel_read_pos += 1;
             }
@@ -181,6 +424,60 @@ private:
             }
             frames_rendered += frame_count;
         }
+
+        auto latency {0.0};
+        if (!soundio_outstream_get_latency(stream, &latency)) {
+            renderer->output_latency = latency;
+        }
+    }
+
+    static void audio_input_callback(SoundIoInStream* stream, int frame_count_min, int frame_count_max) {
+        auto renderer {static_cast<audio_process::impl*>(stream->userdata)};
+        auto ring {renderer->input_ring};
+        auto channel_count {stream->layout.channel_count};
+        auto frame_bytes {static_cast<int>(channel_count * sizeof(float))};
+
+        auto free_frames {soundio_ring_buffer_free_count(ring) / frame_bytes};
+        auto frames_left {std::min(free_frames, frame_count_max)};
+        if (frames_left < frame_count_min) {
+            // The renderer is not keeping up, let the backend drop what does not fit.
+            frames_left = frame_count_min;
+        }
+
+        auto areas {static_cast<SoundIoChannelArea*>(nullptr)};
+        while (frames_left > 0) {
+            auto frame_count {frames_left};
+            if (soundio_instream_begin_read(stream, &areas, &frame_count)) {
+                throw audio_exception {"soundio_instream_begin_read failed"};
+            }
+            if (frame_count == 0) {
+                break;
+            }
+
+            auto writable_frames {std::min(frame_count, soundio_ring_buffer_free_count(ring) / frame_bytes)};
+            auto write_ptr {reinterpret_cast<float*>(soundio_ring_buffer_write_ptr(ring))};
+            if (!areas) {
+                // Hole in the capture stream, fill it with silence.
+                std::memset(write_ptr, 0, writable_frames * frame_bytes);
+            } else {
+                for (auto i {0}; i < writable_frames; ++i) {
+                    for (auto c {0}; c < channel_count; ++c) {
+                        write_ptr[i * channel_count + c] = *(float*)(areas[c].ptr + areas[c].step * i);
+                    }
+                }
+            }
+            soundio_ring_buffer_advance_write_ptr(ring, writable_frames * frame_bytes);
+
+            if (soundio_instream_end_read(stream)) {
+                throw audio_exception {"soundio_instream_end_read failed"};
+            }
+            frames_left -= frame_count;
+        }
+
+        auto latency {0.0};
+        if (!soundio_instream_get_latency(stream, &latency)) {
+            renderer->input_latency = latency;
+        }
     }
 };
 
@@ -196,10 +493,28 @@ void audio_process::configurer::set_right_channel_buffer(audio_pipeline::buffer_
     audio_process_internals->buffer_right_valid = true;
 }
 
+void audio_process::configurer::set_left_input_channel_buffer(audio_pipeline::buffer_handle bhandle) {
+    audio_process_internals->input_buffer_left = bhandle;
+    audio_process_internals->input_buffer_left_valid = true;
+}
+
+void audio_process::configurer::set_right_input_channel_buffer(audio_pipeline::buffer_handle bhandle) {
+    audio_process_internals->input_buffer_right = bhandle;
+    audio_process_internals->input_buffer_right_valid = true;
+}
+
 audio_pipeline& audio_process::configurer::get_pipeline() const {
     return audio_process_internals->pipeline;
 }
 
+void audio_process::configurer::swap_pipeline(audio_pipeline& pipeline) {
+    std::swap(audio_process_internals->pipeline, pipeline);
+}
+
+void audio_process::configurer::declick() {
+    audio_process_internals->render_ahead();
+}
+
 audio_process::audio_process() : internal{new impl} {
     audio_process_instance_count += 1;
     if (audio_process_instance_count > 1) {
@@ -225,6 +540,33 @@ audio_process::~audio_process() {
     }
 }
 
+bool audio_process::start_input() {
+    if (!global_audio_enabled() || !global_audio_input_enabled()) {
+        return true;
+    }
+    return internal->init_input();
+}
+
+audio_config const& audio_process::get_audio_config() const {
+    return internal->get_audio_config();
+}
+
+double audio_process::get_round_trip_latency() const {
+    return internal->get_round_trip_latency();
+}
+
+void audio_process::note_on(float note, float velocity) {
+    while (!internal->config_lock.try_lock()) {}
+    internal->incoming_notes.push_back({note, velocity, true});
+    internal->config_lock.unlock();
+}
+
+void audio_process::note_off(float note) {
+    while (!internal->config_lock.try_lock()) {}
+    internal->incoming_notes.push_back({note, 0.0f, false});
+    internal->config_lock.unlock();
+}
+
 void audio_process::configure(void* payload, void (*configure_callback)(audio_process::configurer& process_configurer, void* payload), void (*cleanup_callback)(void* payload)) {
     while (!internal->config_lock.try_lock()) {}
     internal->incoming_configuration_callbacks.push({payload, configure_callback});
@@ -28,8 +28,19 @@ public:
     struct configurer {
         void set_left_channel_buffer(audio_pipeline::buffer_handle bhandle);
         void set_right_channel_buffer(audio_pipeline::buffer_handle bhahdle);
+        void set_left_input_channel_buffer(audio_pipeline::buffer_handle bhandle);
+        void set_right_input_channel_buffer(audio_pipeline::buffer_handle bhandle);
         audio_pipeline& get_pipeline() const;
 
+        // Runs pipeline from now on, built for the audio config of the process. pipeline gets the one
+        // it replaces, so a pipeline can be built and optimised before the audio thread takes it over.
+        void swap_pipeline(audio_pipeline& pipeline);
+
+        // Crossfades the first block after this configuration from what the pipeline as it is renders
+        // for it, hiding the jump of a configuration changing how the signal flows. Must come before
+        // the configuration changes anything. Generators it keeps run that block twice.
+        void declick();
+
     private:
         friend struct audio_process;
         configurer(impl* internals);
@@ -43,8 +54,21 @@ public:
     audio_process& operator=(audio_process&& other);
     ~audio_process();
 
+    // Opens the default capture device, for pipelines reading the input channels. Returns false when
+    // it could not be opened, the input channels stay silent then. Does nothing with audio input off.
+    bool start_input();
+
+    audio_config const& get_audio_config() const;
+
+    // Plays note on every voice pool of the pipeline from the next block on, until its note off.
+    void note_on(float note, float velocity);
+    void note_off(float note);
+
     void configure(void* payload, void (*configure_callback)(configurer& process_configurer, void* payload), void (*cleanup_callback)(void* payload));
 
+    // Capture to playback latency in seconds, as last reported by the backend plus the frames queued in between.
+    double get_round_trip_latency() const;
+
     // TODO: soundio_wait_events(audio_instance), what do?
 };
 
@@ -0,0 +1,116 @@
+#include "file_watcher.hh"
+
+#include <map>
+#include <set>
+#include <cstddef>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace bzzt {
+
+namespace {
+
+// Events of files being saved: written and closed, or moved into the directory over the old file.
+const unsigned int WATCHED_EVENTS {IN_CLOSE_WRITE | IN_MOVED_TO};
+
+std::string get_directory(std::string const& path) {
+    auto separator_pos {path.rfind('/')};
+    if (separator_pos == std::string::npos) {
+        return ".";
+    }
+    return separator_pos == 0 ? "/" : path.substr(0, separator_pos);
+}
+
+std::string get_filename(std::string const& path) {
+    auto separator_pos {path.rfind('/')};
+    return separator_pos == std::string::npos ? path : path.substr(separator_pos + 1);
+}
+
+}
+
+struct file_watcher::impl {
+    int inotify_fd {-1};
+
+    // Watch descriptor of every watched directory, and the watched paths by directory and filename.
+    std::map<std::string, int> directory_watches;
+    std::map<int, std::map<std::string, std::string>> watched_files;
+};
+
+file_watcher::file_watcher() : internal{new impl} {
+    internal->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+
+file_watcher::~file_watcher() {
+    if (internal->inotify_fd != -1) {
+        close(internal->inotify_fd);
+    }
+    delete internal;
+}
+
+void file_watcher::watch(std::vector<std::string> const& paths) {
+    if (internal->inotify_fd == -1) {
+        return;
+    }
+
+    // Directories watched already keep their watch, only new ones are added and gone ones removed.
+    std::map<std::string, std::map<std::string, std::string>> files_by_directory {};
+    for (auto const& path : paths) {
+        files_by_directory[get_directory(path)][get_filename(path)] = path;
+    }
+    for (auto iter {std::begin(internal->directory_watches)}; iter != std::end(internal->directory_watches);) {
+        if (files_by_directory.find(iter->first) == files_by_directory.end()) {
+            inotify_rm_watch(internal->inotify_fd, iter->second);
+            internal->watched_files.erase(iter->second);
+            iter = internal->directory_watches.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+
+    for (auto& directory_files : files_by_directory) {
+        auto const& directory {directory_files.first};
+        auto watch_iter {internal->directory_watches.find(directory)};
+        if (watch_iter == internal->directory_watches.end()) {
+            auto watch_descriptor {inotify_add_watch(internal->inotify_fd, directory.c_str(), WATCHED_EVENTS)};
+            if (watch_descriptor == -1) {
+                continue;
+            }
+            watch_iter = internal->directory_watches.insert({directory, watch_descriptor}).first;
+        }
+        internal->watched_files[watch_iter->second] = std::move(directory_files.second);
+    }
+}
+
+std::vector<std::string> file_watcher::poll_changes() {
+    std::set<std::string> changed_paths {};
+    if (internal->inotify_fd == -1) {
+        return {};
+    }
+
+    alignas(inotify_event) char events[4096];
+    while (true) {
+        auto length {read(internal->inotify_fd, events, sizeof(events))};
+        if (length <= 0) {
+            break;
+        }
+        for (ptrdiff_t offset {0}; offset < length;) {
+            auto event {reinterpret_cast<inotify_event const*>(events + offset)};
+            offset += sizeof(inotify_event) + event->len;
+            if (event->len == 0) {
+                continue;
+            }
+            auto files_iter {internal->watched_files.find(event->wd)};
+            if (files_iter == internal->watched_files.end()) {
+                continue;
+            }
+            auto path_iter {files_iter->second.find(event->name)};
+            if (path_iter != files_iter->second.end()) {
+                changed_paths.insert(path_iter->second);
+            }
+        }
+    }
+
+    return {std::begin(changed_paths), std::end(changed_paths)};
+}
+
+}
\ No newline at end of file
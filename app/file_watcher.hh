@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace bzzt {
+
+// Reports changes to files on disk, checked without blocking. The directories holding the files are
+// watched rather than the files themselves, so editors saving by renaming a new file over the old
+// one are noticed as well.
+struct file_watcher {
+    file_watcher();
+    file_watcher(file_watcher const& other) = delete;
+    file_watcher(file_watcher&& other) = delete;
+    file_watcher& operator=(file_watcher const& other) = delete;
+    file_watcher& operator=(file_watcher&& other) = delete;
+    ~file_watcher();
+
+    // Replaces the watched files. Files that do not exist yet are noticed once they are created.
+    void watch(std::vector<std::string> const& paths);
+
+    // Watched files written or replaced since the last call, each one once.
+    std::vector<std::string> poll_changes();
+
+private:
+    struct impl;
+    impl* internal;
+};
+
+}
\ No newline at end of file
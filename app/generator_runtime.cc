@@ -0,0 +1,200 @@
+#include "generator_runtime.hh"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <libtcc.h>
+
+namespace bzzt {
+
+namespace {
+
+// Audio grade approximations: errors stay well below what a 16 bit output can resolve.
+// The block variants are plain branchless loops the compiler can vectorise.
+
+const float PI     {3.14159265358979323846f};
+const float TWO_PI {2.0f * PI};
+
+const unsigned int SINE_TABLE_SIZE {4096};
+
+std::array<float, SINE_TABLE_SIZE + 1> make_sine_table() {
+    std::array<float, SINE_TABLE_SIZE + 1> table {};
+    for (unsigned int i {0}; i <= SINE_TABLE_SIZE; ++i) {
+        table[i] = static_cast<float>(std::sin(2.0 * 3.14159265358979323846 * i / SINE_TABLE_SIZE));
+    }
+    return table;
+}
+
+std::array<float, SINE_TABLE_SIZE + 1> const sine_table {make_sine_table()};
+
+// Sine of a phase given in turns, linearly interpolated from the table.
+float table_sine(float turns) {
+    auto position {(turns - std::floor(turns)) * static_cast<float>(SINE_TABLE_SIZE)};
+    auto index {static_cast<unsigned int>(position)};
+    auto fraction {position - static_cast<float>(index)};
+    index &= SINE_TABLE_SIZE - 1;
+    return sine_table[index] + (sine_table[index + 1] - sine_table[index]) * fraction;
+}
+
+// Sine of a phase in turns from a polynomial instead of the table, so block loops vectorise.
+float polynomial_sine(float turns) {
+    auto x {turns - std::floor(turns + 0.5f)};
+    auto folded {0.5f - std::fabs(x)};
+    auto y {std::fabs(x) > 0.25f ? folded : std::fabs(x)};
+    auto sign {x < 0.0f ? -1.0f : 1.0f};
+    auto t {y * TWO_PI};
+    auto t2 {t * t};
+    return sign * t * (1.0f + t2 * (-1.0f / 6.0f + t2 * (1.0f / 120.0f + t2 * (-1.0f / 5040.0f + t2 * (1.0f / 362880.0f)))));
+}
+
+float fast_exp2(float x) {
+    x = std::fmin(std::fmax(x, -126.0f), 126.0f);
+    auto whole {std::floor(x + 0.5f)};
+    auto f {x - whole};
+    auto mantissa {1.0f + f * (0.693147181f + f * (0.240226507f + f * (0.0555041087f + f * (0.00961812911f + f * (0.00133335581f + f * 0.000154035304f)))))};
+    auto bits {static_cast<std::uint32_t>(static_cast<std::int32_t>(whole) + 127) << 23};
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return mantissa * scale;
+}
+
+// The mantissa is brought into [sqrt(1/2), sqrt(2)) where the atanh series converges quickly.
+float fast_log2(float x) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    auto exponent {static_cast<float>(static_cast<std::int32_t>((bits >> 23) & 0xff) - 127)};
+    bits = (bits & 0x007fffff) | 0x3f800000;
+    float m;
+    std::memcpy(&m, &bits, sizeof(m));
+    auto high {m > 1.41421356f};
+    m = high ? m * 0.5f : m;
+    exponent = high ? exponent + 1.0f : exponent;
+    auto s {(m - 1.0f) / (m + 1.0f)};
+    auto s2 {s * s};
+    return exponent + 2.88539008f * s * (1.0f + s2 * (1.0f / 3.0f + s2 * (1.0f / 5.0f + s2 * (1.0f / 7.0f))));
+}
+
+// Pade approximant, exact at the clamp points so the curve meets +-1 without a step.
+float fast_tanh(float x) {
+    x = std::fmin(std::fmax(x, -4.97f), 4.97f);
+    auto x2 {x * x};
+    auto value {x * (135135.0f + x2 * (17325.0f + x2 * (378.0f + x2))) / (135135.0f + x2 * (62370.0f + x2 * (3150.0f + x2 * 28.0f)))};
+    return std::fmin(std::fmax(value, -1.0f), 1.0f);
+}
+
+// xorshift32, the state must not be zero.
+float white_noise(unsigned int* state) {
+    auto s {*state};
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    *state = s;
+    return static_cast<float>(static_cast<std::int32_t>(s)) * (1.0f / 2147483648.0f);
+}
+
+const float LOG2_E     {1.44269504f};
+const float DB_TO_LOG2 {0.166096404f};
+const float LOG2_TO_DB {6.02059991f};
+
+extern "C" {
+
+float bzzt_sin(float x)    { return table_sine(x * (1.0f / TWO_PI)); }
+float bzzt_cos(float x)    { return table_sine(x * (1.0f / TWO_PI) + 0.25f); }
+float bzzt_exp(float x)    { return fast_exp2(x * LOG2_E); }
+float bzzt_exp2(float x)   { return fast_exp2(x); }
+float bzzt_log2(float x)   { return fast_log2(x); }
+float bzzt_pow(float x, float y) { return fast_exp2(y * fast_log2(x)); }
+float bzzt_tanh(float x)   { return fast_tanh(x); }
+float bzzt_db_to_gain(float db)   { return fast_exp2(db * DB_TO_LOG2); }
+float bzzt_gain_to_db(float gain) { return fast_log2(gain) * LOG2_TO_DB; }
+float bzzt_noise(unsigned int* state) { return white_noise(state); }
+
+void bzzt_sin_block(float const* in, float* out, unsigned int count) {
+    for (unsigned int i {0}; i < count; ++i) {
+        out[i] = polynomial_sine(in[i] * (1.0f / TWO_PI));
+    }
+}
+
+void bzzt_tanh_block(float const* in, float* out, unsigned int count) {
+    for (unsigned int i {0}; i < count; ++i) {
+        out[i] = fast_tanh(in[i]);
+    }
+}
+
+void bzzt_exp_block(float const* in, float* out, unsigned int count) {
+    for (unsigned int i {0}; i < count; ++i) {
+        out[i] = fast_exp2(in[i] * LOG2_E);
+    }
+}
+
+void bzzt_db_to_gain_block(float const* in, float* out, unsigned int count) {
+    for (unsigned int i {0}; i < count; ++i) {
+        out[i] = fast_exp2(in[i] * DB_TO_LOG2);
+    }
+}
+
+void bzzt_noise_block(unsigned int* state, float* out, unsigned int count) {
+    for (unsigned int i {0}; i < count; ++i) {
+        out[i] = white_noise(state);
+    }
+}
+
+}
+
+struct runtime_symbol {
+    char const* name;
+    void const* address;
+};
+
+runtime_symbol const runtime_symbols[] {
+    {"bzzt_sin",              reinterpret_cast<void const*>(&bzzt_sin)},
+    {"bzzt_cos",              reinterpret_cast<void const*>(&bzzt_cos)},
+    {"bzzt_exp",              reinterpret_cast<void const*>(&bzzt_exp)},
+    {"bzzt_exp2",             reinterpret_cast<void const*>(&bzzt_exp2)},
+    {"bzzt_log2",             reinterpret_cast<void const*>(&bzzt_log2)},
+    {"bzzt_pow",              reinterpret_cast<void const*>(&bzzt_pow)},
+    {"bzzt_tanh",             reinterpret_cast<void const*>(&bzzt_tanh)},
+    {"bzzt_db_to_gain",       reinterpret_cast<void const*>(&bzzt_db_to_gain)},
+    {"bzzt_gain_to_db",       reinterpret_cast<void const*>(&bzzt_gain_to_db)},
+    {"bzzt_noise",            reinterpret_cast<void const*>(&bzzt_noise)},
+    {"bzzt_sin_block",        reinterpret_cast<void const*>(&bzzt_sin_block)},
+    {"bzzt_tanh_block",       reinterpret_cast<void const*>(&bzzt_tanh_block)},
+    {"bzzt_exp_block",        reinterpret_cast<void const*>(&bzzt_exp_block)},
+    {"bzzt_db_to_gain_block", reinterpret_cast<void const*>(&bzzt_db_to_gain_block)},
+    {"bzzt_noise_block",      reinterpret_cast<void const*>(&bzzt_noise_block)},
+};
+
+// The #line directive keeps line numbers in compile errors relative to the generator file.
+std::string const runtime_header {
+    "float bzzt_sin(float x);\n"
+    "float bzzt_cos(float x);\n"
+    "float bzzt_exp(float x);\n"
+    "float bzzt_exp2(float x);\n"
+    "float bzzt_log2(float x);\n"
+    "float bzzt_pow(float x, float y);\n"
+    "float bzzt_tanh(float x);\n"
+    "float bzzt_db_to_gain(float db);\n"
+    "float bzzt_gain_to_db(float gain);\n"
+    "float bzzt_noise(unsigned int* state);\n"
+    "void bzzt_sin_block(float const* in, float* out, unsigned int count);\n"
+    "void bzzt_tanh_block(float const* in, float* out, unsigned int count);\n"
+    "void bzzt_exp_block(float const* in, float* out, unsigned int count);\n"
+    "void bzzt_db_to_gain_block(float const* in, float* out, unsigned int count);\n"
+    "void bzzt_noise_block(unsigned int* state, float* out, unsigned int count);\n"
+    "#line 1\n"
+};
+
+}
+
+std::string const& get_generator_runtime_header() {
+    return runtime_header;
+}
+
+void add_generator_runtime_symbols(TCCState* tcc_state) {
+    for (auto const& symbol : runtime_symbols) {
+        tcc_add_symbol(tcc_state, symbol.name, symbol.address);
+    }
+}
+
+}
\ No newline at end of file
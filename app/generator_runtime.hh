@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+
+struct TCCState;
+
+namespace bzzt {
+
+// Declarations of the runtime functions as generator code sees them, prepended to every generator.
+std::string const& get_generator_runtime_header();
+
+// Makes the runtime functions resolvable by the generator compiled in tcc_state.
+void add_generator_runtime_symbols(TCCState* tcc_state);
+
+}
\ No newline at end of file
@@ -4,16 +4,24 @@
 namespace bzzt {
 
 void message_box::push_error(std::string const& msg) {
+    std::lock_guard<std::mutex> guard {lock};
     messages.push("ERROR: " + msg);
 }
 
+void message_box::push_info(std::string const& msg) {
+    std::lock_guard<std::mutex> guard {lock};
+    messages.push("INFO: " + msg);
+}
+
 std::string message_box::pop() {
+    std::lock_guard<std::mutex> guard {lock};
     auto msg {messages.front()};
     messages.pop();
     return msg;
 }
 
 unsigned int message_box::length() const {
+    std::lock_guard<std::mutex> guard {lock};
     return messages.size();
 }
 
@@ -2,16 +2,21 @@
 
 #include <string>
 #include <queue>
+#include <mutex>
 
 namespace bzzt {
 
 struct message_box {
     void push_error(std::string const& msg);
+    void push_info(std::string const& msg);
     std::string pop();
     unsigned int length() const;
 
 private:
     std::queue<std::string> messages;
+
+    // Messages may be pushed by the audio thread while being read elsewhere.
+    mutable std::mutex lock;
 };
 
 }
\ No newline at end of file
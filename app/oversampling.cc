@@ -0,0 +1,123 @@
+#include "oversampling.hh"
+
+#include <algorithm>
+#include <cmath>
+
+namespace bzzt {
+
+namespace {
+
+// Taps of the FIR branch, the even taps of a Blackman windowed half-band sinc. The delay branch is
+// the centre tap of 0.5, so the branch taps are scaled to sum to the other 0.5 of unity gain.
+std::array<float, HALFBAND_BRANCH_TAPS> make_halfband_taps() {
+    std::array<double, HALFBAND_BRANCH_TAPS> taps {};
+    auto const pi {3.14159265358979323846};
+    auto const length {2.0 * HALFBAND_BRANCH_TAPS - 2.0};
+    auto sum {0.0};
+    for (unsigned int k {0}; k < HALFBAND_BRANCH_TAPS; ++k) {
+        auto j {2.0 * k};
+        auto n {j - (HALFBAND_BRANCH_TAPS - 1.0)};
+        auto sinc {std::sin(pi * n / 2.0) / (pi * n / 2.0)};
+        auto window {0.42 - 0.5 * std::cos(2.0 * pi * j / length) + 0.08 * std::cos(4.0 * pi * j / length)};
+        taps[k] = 0.5 * sinc * window;
+        sum += taps[k];
+    }
+    std::array<float, HALFBAND_BRANCH_TAPS> scaled {};
+    for (unsigned int k {0}; k < HALFBAND_BRANCH_TAPS; ++k) {
+        scaled[k] = static_cast<float>(taps[k] * 0.5 / sum);
+    }
+    return scaled;
+}
+
+std::array<float, HALFBAND_BRANCH_TAPS> const halfband_taps {make_halfband_taps()};
+
+// Index of the sample of the delay branch, counted back from the newest input.
+const unsigned int HALFBAND_DELAY {HALFBAND_BRANCH_TAPS / 2 - 1};
+
+float branch_fir(float const* newest) {
+    auto acc {0.0f};
+    for (unsigned int k {0}; k < HALFBAND_BRANCH_TAPS; ++k) {
+        acc += halfband_taps[k] * *(newest - k);
+    }
+    return acc;
+}
+
+}
+
+void halfband_upsampler::process(float const* in, unsigned int count, float* out, float* work) {
+    auto const history_size {static_cast<unsigned int>(history.size())};
+    std::copy(std::begin(history), std::end(history), work);
+    std::copy(in, in + count, work + history_size);
+
+    for (unsigned int m {0}; m < count; ++m) {
+        auto newest {work + history_size + m};
+        out[2 * m]     = 2.0f * branch_fir(newest);
+        out[2 * m + 1] = *(newest - HALFBAND_DELAY);
+    }
+
+    std::copy(work + count, work + count + history_size, std::begin(history));
+}
+
+void halfband_downsampler::process(float const* in, unsigned int count, float* out, float* work) {
+    auto const even_history_size {static_cast<unsigned int>(even_history.size())};
+    auto const odd_history_size  {static_cast<unsigned int>(odd_history.size())};
+    auto even {work};
+    auto odd  {work + even_history_size + count};
+
+    std::copy(std::begin(even_history), std::end(even_history), even);
+    std::copy(std::begin(odd_history), std::end(odd_history), odd);
+    for (unsigned int i {0}; i < count; ++i) {
+        even[even_history_size + i] = in[2 * i];
+        odd[odd_history_size + i]   = in[2 * i + 1];
+    }
+
+    for (unsigned int m {0}; m < count; ++m) {
+        out[m] = branch_fir(even + even_history_size + m) + 0.5f * odd[odd_history_size + m - HALFBAND_DELAY - 1];
+    }
+
+    std::copy(even + count, even + count + even_history_size, std::begin(even_history));
+    std::copy(odd + count, odd + count + odd_history_size, std::begin(odd_history));
+}
+
+oversampler::oversampler(unsigned int factor) : factor{factor}, up_stages{}, down_stages{} {
+    for (auto f {factor}; f > 1; f /= 2) {
+        up_stages.push_back({});
+        down_stages.push_back({});
+    }
+}
+
+// Two ping-pong areas for the intermediate rates, followed by the scratch of the stage filters.
+unsigned int oversampler::work_size(unsigned int count, unsigned int factor) {
+    return 2 * count * factor + 2 * (count * factor + HALFBAND_BRANCH_TAPS);
+}
+
+void oversampler::upsample(float const* in, unsigned int count, float* out, float* work) {
+    auto ping {work};
+    auto pong {work + count * factor};
+    auto filter_work {work + 2 * count * factor};
+
+    auto source {in};
+    for (unsigned int stage {0}; stage < up_stages.size(); ++stage) {
+        auto last {stage + 1 == up_stages.size()};
+        auto target {last ? out : (stage % 2 == 0 ? ping : pong)};
+        up_stages[stage].process(source, count << stage, target, filter_work);
+        source = target;
+    }
+}
+
+void oversampler::downsample(float const* in, unsigned int count, float* out, float* work) {
+    auto ping {work};
+    auto pong {work + count * factor};
+    auto filter_work {work + 2 * count * factor};
+
+    auto source {in};
+    auto stages {static_cast<unsigned int>(down_stages.size())};
+    for (unsigned int stage {0}; stage < stages; ++stage) {
+        auto last {stage + 1 == stages};
+        auto target {last ? out : (stage % 2 == 0 ? ping : pong)};
+        down_stages[stage].process(source, count << (stages - stage - 1), target, filter_work);
+        source = target;
+    }
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+namespace bzzt {
+
+// Two times up- and downsampling through a 23 tap half-band FIR, run as its two polyphase
+// branches: one is a 12 tap FIR, the other a plain delay. The delay is 5.5 samples at the
+// lower rate per stage in each direction.
+const unsigned int HALFBAND_BRANCH_TAPS {12};
+
+struct halfband_upsampler {
+    // Writes 2 * count samples to out. work needs room for count + HALFBAND_BRANCH_TAPS samples.
+    void process(float const* in, unsigned int count, float* out, float* work);
+
+    std::array<float, HALFBAND_BRANCH_TAPS - 1> history {};
+};
+
+struct halfband_downsampler {
+    // Reads 2 * count samples from in. work needs room for 2 * (count + HALFBAND_BRANCH_TAPS) samples.
+    void process(float const* in, unsigned int count, float* out, float* work);
+
+    std::array<float, HALFBAND_BRANCH_TAPS - 1> even_history {};
+    std::array<float, HALFBAND_BRANCH_TAPS / 2> odd_history {};
+};
+
+// Cascade of half-band stages for a factor of 2, 4 or 8. Only the filter histories live here,
+// scratch memory is passed in so every port of every step can share one preallocated area.
+struct oversampler {
+    explicit oversampler(unsigned int factor);
+
+    // count is the number of samples at the lower rate in both directions.
+    void upsample   (float const* in, unsigned int count, float* out, float* work);
+    void downsample (float const* in, unsigned int count, float* out, float* work);
+
+    static unsigned int work_size(unsigned int count, unsigned int factor);
+
+    unsigned int factor;
+    std::vector<halfband_upsampler> up_stages;
+    std::vector<halfband_downsampler> down_stages;
+};
+
+}
\ No newline at end of file
@@ -1,88 +1,139 @@
 #include "parsers.hh"
 
-#include <regex>
-#include <algorithm>
 #include <cmath>
 
 namespace bzzt {
 
 namespace {
 
-std::vector<char> whitespace_chars {' ', '\n', '\t', '\r'};
-std::vector<char> group_begin_chars {'(', '[', '{'};
-std::vector<char> group_end_chars {')', ']', '}'};
+bool is_whitespace(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
 
+bool is_group_begin(char c) {
+    return c == '(' || c == '[' || c == '{';
 }
 
-std::vector<std::string> parse_sections(std::string const& str) {
-    std::vector<std::string> vec {};
+bool is_group_end(char c) {
+    return c == ')' || c == ']' || c == '}';
+}
 
-    std::regex section_regex {"\\[([^\\]]+)\\]\\n([^\\[]+)"};
-    std::sregex_iterator next {begin(str), end(str), section_regex};
-    std::sregex_iterator end;
+}
 
-    for (; next != end; ++next) {
-        auto match {*next};
-        vec.push_back(match[1]);
-        vec.push_back(match[2]);
+std::vector<text_token> parse_sections(std::string_view str) {
+    std::vector<text_token> vec {};
+
+    // Contents of the current section start on the line after its name, and end where the next name starts.
+    auto contents_start {std::string_view::npos};
+    auto end_contents {[&](std::string_view::size_type contents_end) {
+        if (contents_start != std::string_view::npos) {
+            vec.back().text = str.substr(contents_start, contents_end - contents_start);
+        }
+    }};
+
+    for (auto const& line : parse_lines({str, 1, 1})) {
+        if (line.text.size() < 3 || line.text.front() != '[' || line.text.back() != ']') {
+            continue;
+        }
+        auto line_start {static_cast<std::string_view::size_type>(line.text.data() - str.data())};
+        end_contents(line_start);
+
+        auto line_break {str.find('\n', line_start)};
+        contents_start = line_break == std::string_view::npos ? str.size() : line_break + 1;
+        vec.push_back({line.text.substr(1, line.text.size() - 2), line.line, 2});
+        vec.push_back({{}, line.line + 1, 1});
     }
+    end_contents(str.size());
 
     return vec;
 }
 
-std::vector<std::string> parse_lines(std::string const& str) {
-    std::vector<std::string> vec {};
+std::vector<text_token> parse_lines(text_token const& token) {
+    std::vector<text_token> vec {};
 
-    std::regex line_regex {"(.+?)\\n"};
-    std::sregex_iterator next {begin(str), end(str), line_regex};
-    std::sregex_iterator end;
+    auto const& str {token.text};
+    auto line {token.line};
+    auto column {token.column};
 
-    for (; next != end; ++next) {
-        auto match {*next};
-        vec.push_back(match[1]);
+    std::string_view::size_type start {0};
+    while (start < str.size()) {
+        auto end {str.find('\n', start)};
+        auto line_end {end == std::string_view::npos ? str.size() : end};
+        auto content_end {line_end > start && str[line_end - 1] == '\r' ? line_end - 1 : line_end};
+        if (content_end > start) {
+            vec.push_back({str.substr(start, content_end - start), line, column});
+        }
+
+        if (end == std::string_view::npos) {
+            break;
+        }
+        start = end + 1;
+        line += 1;
+        column = 1;
     }
 
     return vec;
 }
 
-std::vector<std::string> parse_whitespace_separated_values(std::string const& str) {
-    std::vector<std::string> vec {};
+std::vector<text_token> parse_whitespace_separated_values(text_token const& token) {
+    std::vector<text_token> vec {};
 
-    std::string value {};
+    auto const& str {token.text};
+    auto line {token.line};
+    auto column {token.column};
+
+    std::string_view::size_type value_start {0};
+    text_token value {};
     auto parsing_value {false};
     unsigned int indent_level {0};
 
-    for (unsigned int i {0}; i < str.size(); ++i) {
-        if (!parsing_value && std::find(std::begin(whitespace_chars), std::end(whitespace_chars), str[i]) == std::end(whitespace_chars)) {
+    for (std::string_view::size_type i {0}; i < str.size(); ++i) {
+        auto c {str[i]};
+        if (!parsing_value && !is_whitespace(c)) {
             parsing_value = true;
+            value_start = i;
+            value.line = line;
+            value.column = column;
         }
 
         if (parsing_value) {
-            if (std::find(std::begin(group_begin_chars), std::end(group_begin_chars), str[i]) != std::end(group_begin_chars)) {
+            if (is_group_begin(c)) {
                 indent_level += 1;
             }
-            if (std::find(std::begin(group_end_chars), std::end(group_end_chars), str[i]) != std::end(group_end_chars) && indent_level > 0) {
+            if (is_group_end(c) && indent_level > 0) {
                 indent_level -= 1;
             }
-            if (std::find(std::begin(whitespace_chars), std::end(whitespace_chars), str[i]) != std::end(whitespace_chars) && indent_level == 0) {
+            if (is_whitespace(c) && indent_level == 0) {
                 parsing_value = false;
+                value.text = str.substr(value_start, i - value_start);
                 vec.push_back(value);
-                value = "";
-                continue;
             }
+        }
 
-            value.push_back(str[i]);
+        if (c == '\n') {
+            line += 1;
+            column = 1;
+        } else {
+            column += 1;
         }
     }
 
-    if (value.size() > 0) {
+    if (parsing_value) {
+        value.text = str.substr(value_start);
         vec.push_back(value);
     }
 
     return vec;
 }
 
-unsigned int parse_unsigned_int(std::string const& str) {
+text_token strip_enclosing(text_token const& token) {
+    if (token.text.size() < 2) {
+        return {{}, token.line, token.column};
+    }
+    return {token.text.substr(1, token.text.size() - 2), token.line, token.column + 1};
+}
+
+unsigned int parse_unsigned_int(std::string_view str) {
     unsigned int val {0};
 
     for (unsigned int i {0}; i < str.size() && str[i] >= '0' && str[i] <= '9'; ++i) {
@@ -93,7 +144,7 @@ unsigned int parse_unsigned_int(std::string const& str) {
     return val;
 }
 
-float parse_float(std::string const& str) {
+float parse_float(std::string_view str) {
     float val {0.0f};
 
     unsigned dot_pos {0};
@@ -2,22 +2,38 @@
 
 #include <vector>
 #include <string>
-#include <array>
+#include <string_view>
 
 namespace bzzt {
 
-// [ <section> <contents> ] ...
-std::vector<std::string> parse_sections(std::string const& str);
+// Piece of a text being parsed, viewing into it, and where it starts in the text. Lines and columns
+// count from 1.
+struct text_token {
+    std::string_view text;
+    unsigned int line;
+    unsigned int column;
+};
+
+// [<section>]
+// <contents>
+// ...
+// Section names alternate with their contents. A section starts with a line holding only its name
+// in square brackets, and runs up to the next one.
+std::vector<text_token> parse_sections(std::string_view str);
 
 // <line> ...
-std::vector<std::string> parse_lines(std::string const& str);
+// Empty lines are skipped, a trailing carriage return is not part of the line.
+std::vector<text_token> parse_lines(text_token const& token);
 
 // <value> ...
 // Parenthesized sections are treated as one single value.
-std::vector<std::string> parse_whitespace_separated_values(std::string const& str);
+std::vector<text_token> parse_whitespace_separated_values(text_token const& token);
 
-unsigned int parse_unsigned_int(std::string const& str);
+// The token without its first and last character, e.g. the parentheses around it.
+text_token strip_enclosing(text_token const& token);
 
-float parse_float(std::string const& str);
+unsigned int parse_unsigned_int(std::string_view str);
+
+float parse_float(std::string_view str);
 
 }
\ No newline at end of file
@@ -37,6 +37,12 @@ int main(int argc, char** argv) {
     bzzt::consume_command_line_arguments(argc, argv);
     bzzt::message_box msg_box {};
 
+    if (bzzt::global_compile_only()) {
+        auto compiled {bzzt::compile_pipeline_file(bzzt::get_pipeline_configuration_filename(), msg_box)};
+        debug_console_out(msg_box, compiled ? "Compiled the pipeline config:" : "The pipeline config could not be compiled:");
+        return compiled ? 0 : 1;
+    }
+
     bzzt::window window {WINDOW_WIDTH, WINDOW_HEIGHT};
 
     bzzt::graphics_area graphics_area {};
@@ -46,9 +52,16 @@ int main(int argc, char** argv) {
 
     auto audio_process {std::make_unique<bzzt::audio_process>()};
 
+    // With --watch the pipeline follows edits of its files, see pipeline_reloader.
+    std::unique_ptr<bzzt::pipeline_reloader> pipeline_reloader {};
     auto pipeline_config_filename {bzzt::get_pipeline_configuration_filename()};
     if (pipeline_config_filename.size() > 0) {
-        audio_process = bzzt::load_pipeline_from_file(std::move(audio_process), pipeline_config_filename, msg_box);
+        if (bzzt::global_watch_pipeline()) {
+            pipeline_reloader = std::make_unique<bzzt::pipeline_reloader>(pipeline_config_filename);
+            pipeline_reloader->load(*audio_process, msg_box);
+        } else {
+            audio_process = bzzt::load_pipeline_from_file(std::move(audio_process), pipeline_config_filename, msg_box);
+        }
         auto header {"There was " + std::to_string(msg_box.length()) + " error" + (msg_box.length() > 1 ? "s" : "") + " when trying to load the pipeline config file " + pipeline_config_filename + ":"};
         if (graphics_inited) {
             debug_graphics_out(msg_box, header, graphics_area);
@@ -58,11 +71,31 @@ int main(int argc, char** argv) {
     }
 
     while (!window.should_close()) {
+        if (pipeline_reloader) {
+            pipeline_reloader->reload_changes(*audio_process, msg_box);
+        }
+
+        // The audio process reports on the pipelines it takes in once it has built them.
+        debug_console_out(msg_box, "Messages from the audio process:");
         if (graphics_inited) {
             graphics_area.render();
         }
         window.update_screen();
         window.handle_incoming_events();
+
+        // The keyboard plays the voice pools of the pipeline.
+        for (auto const& event : window.take_note_events()) {
+            if (event.on) {
+                audio_process->note_on(event.note, 1.0f);
+            } else {
+                audio_process->note_off(event.note);
+            }
+        }
+    }
+
+    if (bzzt::global_audio_enabled() && bzzt::global_report_latency()) {
+        msg_box.push_info("Audio round-trip latency: " + std::to_string(audio_process->get_round_trip_latency() * 1000.0) + " ms");
+        debug_console_out(msg_box, "Audio latency:");
     }
 
     graphics_area.deinit();
@@ -9,6 +9,18 @@ namespace {
 
 std::vector<std::string> command_line_arguments;
 
+std::string get_parameter_value(std::string const& param) {
+    for (auto const& arg : command_line_arguments) {
+        auto index {arg.find(param)};
+        if (index != std::string::npos && index == 0 && arg.size() > param.size()) {
+            auto value_length {arg.size() - param.size()};
+            auto value_pos {param.size()};
+            return arg.substr(value_pos, value_length);
+        }
+    }
+    return "";
+}
+
 }
 
 void consume_command_line_arguments(int argc, char** argv) {
@@ -20,17 +32,34 @@ bool global_audio_enabled() {
     return std::find(std::begin(command_line_arguments), end, "--no-audio") == end;
 }
 
+bool global_audio_input_enabled() {
+    auto end {std::end(command_line_arguments)};
+    return std::find(std::begin(command_line_arguments), end, "--no-audio-input") == end;
+}
+
+bool global_compile_only() {
+    auto end {std::end(command_line_arguments)};
+    return std::find(std::begin(command_line_arguments), end, "--compile") != end;
+}
+
+bool global_watch_pipeline() {
+    auto end {std::end(command_line_arguments)};
+    return std::find(std::begin(command_line_arguments), end, "--watch") != end;
+}
+
+bool global_report_latency() {
+    auto end {std::end(command_line_arguments)};
+    return std::find(std::begin(command_line_arguments), end, "--report-latency") != end;
+}
+
 std::string get_pipeline_configuration_filename() {
     static std::string param {"--pipeline-config="};
-    for (auto const& arg : command_line_arguments) {
-        auto index {arg.find(param)};
-        if (index != std::string::npos && index == 0 && arg.size() > param.size()) {
-            auto filename_length {arg.size() - param.size()};
-            auto filename_pos {param.size()};
-            return arg.substr(filename_pos, filename_length);
-        }
-    }
-    return "";
+    return get_parameter_value(param);
+}
+
+std::string get_audio_backend_name() {
+    static std::string param {"--audio-backend="};
+    return get_parameter_value(param);
 }
 
 }
\ No newline at end of file
@@ -7,6 +7,19 @@ namespace bzzt {
 void consume_command_line_arguments(int argc, char** argv);
 
 bool global_audio_enabled();
+bool global_audio_input_enabled();
 std::string get_pipeline_configuration_filename();
 
+// --compile writes the pipeline config compiled next to it and exits, see compile_pipeline_file.
+bool global_compile_only();
+
+// --watch applies edits of the pipeline config and its generators while running, see pipeline_reloader.
+bool global_watch_pipeline();
+
+// --report-latency reports the audio round-trip latency on exit.
+bool global_report_latency();
+
+// "alsa" (default) or "dummy".
+std::string get_audio_backend_name();
+
 }
\ No newline at end of file
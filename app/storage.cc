@@ -1,13 +1,26 @@
 #include "storage.hh"
 
 #include <vector>
+#include <string_view>
 #include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
 #include <algorithm>
 #include <iterator>
 #include <memory>
 #include <map>
+#include <set>
+#include <future>
+#include <atomic>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "parsers.hh"
 #include "audio_pipeline.hh"
+#include "file_watcher.hh"
 
 namespace bzzt {
 
@@ -15,13 +28,25 @@ namespace {
 
 struct generator_section_step {
     std::string generator_code;
+
+    // File the code was read from, compiled pipelines refer to the code by it.
+    std::string path;
+
+    // Set by compile_generators, before the pipeline is configured.
+    std::shared_ptr<audio_pipeline::compiled_generator_type> compiled;
+    std::string id;
+
+    // Object file the code was compiled to, for generators of compiled pipelines.
+    std::string object_path;
 };
 
 struct pipeline_step_input_parameter {
     bool is_buffer;
+    bool is_trigger;
     union {
         unsigned int buffer_id;
         float value;
+        audio_pipeline::voice_trigger trigger;
     };
 };
 
@@ -33,6 +58,28 @@ struct pipeline_section_step {
     std::string generator_type;
     std::vector<pipeline_step_input_parameter> input_parameters;
     std::vector<pipeline_step_output_parameter> output_parameters;
+
+    // Name of the voice pool this step is a template for, empty for ordinary steps.
+    std::string voice_pool;
+
+    bool control_rate;
+    audio_pipeline::control_interpolation control_interpolation;
+
+    unsigned int oversampling;
+
+    // Name of the feedback loop this step runs in, empty for steps run a block at a time.
+    std::string loop;
+};
+
+struct voice_section_step {
+    std::string name;
+    unsigned int voice_count;
+    audio_pipeline::voice_steal_policy policy;
+    unsigned int output_buffer_id;
+    unsigned int mix_buffer_id;
+
+    // Buffers written by the template steps, every voice gets its own copy of them.
+    std::set<unsigned int> private_buffer_ids;
 };
 
 struct output_section_step {
@@ -40,80 +87,172 @@ struct output_section_step {
     unsigned int buffer_id;
 };
 
+struct input_section_step {
+    std::string channel_name;
+    unsigned int buffer_id;
+};
+
+// The steps of a pipeline as optimize left them for the audio config it was built with.
+struct optimised_pipeline_section {
+    audio_config config;
+
+    // Generator id of the type of every step, "bus" for buses.
+    std::vector<std::string> step_types;
+    std::vector<audio_pipeline::step_description> steps;
+    std::vector<std::tuple<unsigned int, unsigned int>> loops;
+
+    // Live buffers no step writes anymore, holding the constant of the folded step that did.
+    std::vector<std::tuple<audio_pipeline::buffer_handle, float>> constant_buffers;
+};
+
 struct pipeline_config_payload {
     std::vector<generator_section_step> generator_section;
     std::vector<pipeline_section_step> pipeline_section;
     std::vector<output_section_step> output_section;
+    std::vector<input_section_step> input_section;
+    std::vector<voice_section_step> voice_section;
     std::map<unsigned int, audio_pipeline::buffer_handle> buffer_id_to_handle;
     std::map<std::string, audio_pipeline::generator_type_handle> generator_type_id_to_impl;
+
+    // Buffers read one block late, see audio_pipeline::set_buffer_feedback.
+    std::set<unsigned int> feedback_buffer_ids;
+
+    // Pipeline step every generator was created for, so the optimisation pass can be reported by step.
+    std::map<audio_pipeline::generator_handle, unsigned int> generator_step_numbers;
+    message_box* msg_box;
+
+    // Built and optimised ahead, the audio thread only swaps it in, see configure_audio_process.
+    std::unique_ptr<audio_pipeline> pipeline;
+
+    // Read from a compiled pipeline, null when the steps have to be added and optimised.
+    std::unique_ptr<optimised_pipeline_section> optimised;
 };
 
-const auto FILE_MAX_BYTES {static_cast<unsigned int>(1024*1024)};
-const auto RESERVATION_SIZE {static_cast<unsigned int>(1024*8)};
+// Contents of a file mapped read-only into memory, unmapped again when this goes away. Empty when
+// the file can not be opened or has nothing in it.
+struct mapped_file {
+    explicit mapped_file(std::string const& path) {
+        auto fd {open(path.c_str(), O_RDONLY)};
+        if (fd == -1) {
+            return;
+        }
+        struct stat file_stat {};
+        if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+            auto address {mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0)};
+            if (address != MAP_FAILED) {
+                data = address;
+                size = static_cast<size_t>(file_stat.st_size);
+            }
+        }
+        close(fd);
+    }
+
+    mapped_file(mapped_file const& other) = delete;
+    mapped_file& operator=(mapped_file const& other) = delete;
 
-std::string get_raw_file_contents(std::string const& path) {
-    auto file {std::ifstream{path}};
-    if (file.fail()) {
-        return "";
+    ~mapped_file() {
+        if (data) {
+            munmap(data, size);
+        }
     }
 
-    file.seekg(0, file.end);
-    auto file_length {file.tellg()};
-    file.seekg(0, file.beg);
-    if (file_length > FILE_MAX_BYTES) {
-        return "";
+    std::string_view contents() const {
+        return data ? std::string_view {static_cast<char const*>(data), size} : std::string_view {};
     }
 
-    auto raw {std::string{}};
-    raw.reserve(RESERVATION_SIZE);
-    raw.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    void* data {nullptr};
+    size_t size {0};
+};
+
+const unsigned int FILE_READ_WORKERS {4};
+
+// Reads the files on a few workers, in the order of paths. Files that can not be read give empty contents.
+std::vector<std::string> read_generator_files(std::vector<std::string> const& paths) {
+    std::vector<std::string> contents(paths.size());
+    std::atomic<unsigned int> next_path {0};
+    auto read_paths {[&]() {
+        for (auto i {next_path++}; i < paths.size(); i = next_path++) {
+            contents[i] = std::string {mapped_file {paths[i]}.contents()};
+        }
+    }};
 
-    return raw;
+    std::vector<std::future<void>> workers {};
+    for (unsigned int i {1}; i < std::min(FILE_READ_WORKERS, static_cast<unsigned int>(paths.size())); ++i) {
+        workers.push_back(std::async(std::launch::async, read_paths));
+    }
+    read_paths();
+    for (auto& worker : workers) {
+        worker.get();
+    }
+    return contents;
 }
 
-bool section_exists(std::vector<std::string> const& parsed_sections, std::string const& section) {
+bool section_exists(std::vector<text_token> const& parsed_sections, std::string_view section) {
     for (unsigned int i {0}; i < parsed_sections.size(); i += 2) {
-        if (parsed_sections[i] == section && parsed_sections.size() > i + 1) {
+        if (parsed_sections[i].text == section && parsed_sections.size() > i + 1) {
             return true;
         }
     }
     return false;
 }
 
-std::string const& get_section(std::vector<std::string> const& parsed_sections, std::string const& section) {
+text_token const& get_section(std::vector<text_token> const& parsed_sections, std::string_view section) {
     for (unsigned int i {0}; i < parsed_sections.size(); i += 2) {
-        if (parsed_sections[i] == section && parsed_sections.size() > i + 1) {
+        if (parsed_sections[i].text == section && parsed_sections.size() > i + 1) {
             return parsed_sections[i + 1];
         }
     }
     return parsed_sections[0];
 }
 
+voice_section_step* find_voice_pool(pipeline_config_payload& payload, std::string_view name) {
+    for (auto& pool : payload.voice_section) {
+        if (pool.name == name) {
+            return &pool;
+        }
+    }
+    return nullptr;
+}
+
+// Where a token starts in the config file, for messages not tied to a pipeline step.
+std::string position_of(text_token const& token) {
+    return "At line " + std::to_string(token.line) + ", column " + std::to_string(token.column);
 }
 
-std::unique_ptr<audio_process> load_pipeline_from_file(std::unique_ptr<audio_process> aprocess, std::string const& path, message_box& msg_box) {
-    auto file_contents {get_raw_file_contents(path)};
+// Parses and checks the config file at path, reading the generator sources it names. Returns null
+// when there was anything to complain about.
+pipeline_config_payload* parse_pipeline_config(std::string const& path, message_box& msg_box) {
+    // The message box is shared with the audio thread, so the errors of this parse are counted apart.
+    unsigned int error_count {0};
+    auto push_error {[&](std::string const& msg) {
+        ++error_count;
+        msg_box.push_error(msg);
+    }};
+
+    // Tokens parsed from the file view into the mapping, everything kept past this function is copied out.
+    mapped_file file {path};
+    auto file_contents {file.contents()};
     if (file_contents.size() == 0) {
-        msg_box.push_error("Pipeline config file " + path + " could not be loaded");
-        return aprocess;
+        push_error("Pipeline config file " + path + " could not be loaded");
+        return nullptr;
     }
 
     auto sections {parse_sections(file_contents)};
     auto bad_sections {false};
     if (!section_exists(sections, "pipeline")) {
-        msg_box.push_error("Pipeline section not specified in " + path);
+        push_error("Pipeline section not specified in " + path);
         bad_sections = true;
     }
     if (!section_exists(sections, "output")) {
-        msg_box.push_error("Output section not specified in " + path);
+        push_error("Output section not specified in " + path);
         bad_sections = true;
     }
     if (!section_exists(sections, "generators")) {
-        msg_box.push_error("Generator section not specified in " + path);
+        push_error("Generator section not specified in " + path);
         bad_sections = true;
     }
     if (bad_sections) {
-        return aprocess;
+        return nullptr;
     }
 
     auto const& generator_section_raw {get_section(sections, "generators")};
@@ -124,67 +263,166 @@ std::unique_ptr<audio_process> load_pipeline_from_file(std::unique_ptr<audio_pro
     auto pipeline_lines  {parse_lines(pipeline_section_raw)};
     auto output_lines    {parse_lines(output_section_raw)};
 
+    // The input section is optional, without it the pipeline runs as a pure generator.
+    auto input_lines {section_exists(sections, "input") ? parse_lines(get_section(sections, "input")) : std::vector<text_token>{}};
+
+    // Optional as well, only needed by pipelines playing notes.
+    auto voice_lines {section_exists(sections, "voices") ? parse_lines(get_section(sections, "voices")) : std::vector<text_token>{}};
+
+    // Optional, only needed by pipelines reading buffers before the steps writing them.
+    auto feedback_lines {section_exists(sections, "feedback") ? parse_lines(get_section(sections, "feedback")) : std::vector<text_token>{}};
+
     // =====================================================================
     // ======================= Parse file contents =========================
     // =====================================================================
     auto payload {new pipeline_config_payload};
-    std::for_each(std::begin(generator_lines), std::end(generator_lines), [&](std::string const& line) {
-        if (line.size() <= 2 || line[0] != '"' || line[line.size() - 1] != '"') {
-            msg_box.push_error("Generator filenames need to be enclosed in double-quotes");
+    payload->msg_box = &msg_box;
+    std::vector<std::string> generator_filenames {};
+    std::for_each(std::begin(generator_lines), std::end(generator_lines), [&](text_token const& line) {
+        if (line.text.size() <= 2 || line.text.front() != '"' || line.text.back() != '"') {
+            push_error(position_of(line) + ": Generator filenames need to be enclosed in double-quotes");
+            return;
+        }
+        generator_filenames.push_back(std::string {strip_enclosing(line).text});
+    });
+
+    auto generator_codes {read_generator_files(generator_filenames)};
+    for (unsigned int i {0}; i < generator_filenames.size(); ++i) {
+        if (generator_codes[i].size() == 0) {
+            push_error("Generator file " + generator_filenames[i] + " could not be loaded");
+            continue;
+        }
+        payload->generator_section.push_back({std::move(generator_codes[i]), generator_filenames[i], nullptr, {}, {}});
+    }
+
+    std::for_each(std::begin(voice_lines), std::end(voice_lines), [&](text_token const& line) {
+        auto splited_line {parse_whitespace_separated_values(line)};
+
+        // Line format: <pool name> <voice count> <steal policy> <voice output buffer id> <mix buffer id>
+        if (splited_line.size() != 5) {
+            push_error(position_of(line) + ": Voice pools need to be defined by a name, a voice count, a steal policy, a voice output buffer id and a mix buffer id");
+            return;
+        }
+
+        auto name        {std::string {splited_line[0].text}};
+        auto policy_name {std::string {splited_line[2].text}};
+
+        if (policy_name != "oldest" && policy_name != "quietest") {
+            push_error("Voice pool " + name + ": Steal policy " + policy_name + " does not exist, use oldest or quietest");
             return;
         }
-        auto filename {line.substr(1, line.size() - 2)};
-        auto code {get_raw_file_contents(filename)};
-        if (code.size() == 0) {
-            msg_box.push_error("Generator file " + filename + " could not be loaded");
+        auto policy {policy_name == "oldest" ? audio_pipeline::voice_steal_policy::oldest : audio_pipeline::voice_steal_policy::quietest};
+
+        auto voice_count {parse_unsigned_int(splited_line[1].text)};
+        if (voice_count == 0) {
+            push_error("Voice pool " + name + ": Needs at least one voice");
             return;
         }
-        payload->generator_section.push_back({code});
+
+        payload->voice_section.push_back({name, voice_count, policy, parse_unsigned_int(splited_line[3].text), parse_unsigned_int(splited_line[4].text), {}});
     });
 
     auto current_line {0};
-    std::for_each(std::begin(pipeline_lines), std::end(pipeline_lines), [&](std::string const& line) {
+    std::for_each(std::begin(pipeline_lines), std::end(pipeline_lines), [&](text_token const& line) {
         ++current_line;
         auto splited_line {parse_whitespace_separated_values(line)};
 
-        // Line format: <generator type> <input parameters> <output parameters>.
-        if (splited_line.size() != 3) {
-            msg_box.push_error("At pipeline step " + std::to_string(current_line) + ": Required parameters not specified (generator name, inputs and outputs)");
+        // Line format: <generator type> <input parameters> <output parameters> [<options>].
+        if (splited_line.size() != 3 && splited_line.size() != 4) {
+            push_error("At pipeline step " + std::to_string(current_line) + ": Required parameters not specified (generator name, inputs and outputs)");
             return;
         }
 
-        auto& generator_type        {splited_line[0]};
-        auto& input_parameters_raw  {splited_line[1]};
-        auto& output_parameters_raw {splited_line[2]};
+        // Options are square bracketed key=value pairs, e.g. [voice=lead control=linear].
+        std::string voice_pool {};
+        auto control_rate {false};
+        auto control_interpolation {audio_pipeline::control_interpolation::hold};
+        auto oversampling {1u};
+        std::string loop {};
+        if (splited_line.size() == 4) {
+            auto const& options_raw {splited_line[3]};
+            if (options_raw.text.size() < 3 || options_raw.text.front() != '[' || options_raw.text.back() != ']') {
+                push_error("At pipeline step " + std::to_string(current_line) + ": Options need to be surrounded by square brackets");
+                return;
+            }
+            auto options {parse_whitespace_separated_values(strip_enclosing(options_raw))};
+            for (auto const& option : options) {
+                auto separator_pos {option.text.find('=')};
+                auto key {std::string {option.text.substr(0, separator_pos)}};
+                auto value {separator_pos != std::string_view::npos ? std::string {option.text.substr(separator_pos + 1)} : std::string{}};
+                if (key == "voice" && find_voice_pool(*payload, value)) {
+                    voice_pool = value;
+                } else if (key == "voice") {
+                    push_error("At pipeline step " + std::to_string(current_line) + ": Voice pool " + value + " is not defined in the voices section");
+                    return;
+                } else if (key == "control" && (value.empty() || value == "hold" || value == "linear")) {
+                    control_rate = true;
+                    control_interpolation = value == "linear" ? audio_pipeline::control_interpolation::linear : audio_pipeline::control_interpolation::hold;
+                } else if (key == "control") {
+                    push_error("At pipeline step " + std::to_string(current_line) + ": Control rate interpolation " + value + " does not exist, use hold or linear");
+                    return;
+                } else if (key == "oversample" && (value == "2" || value == "4" || value == "8")) {
+                    oversampling = std::stoul(value);
+                } else if (key == "oversample") {
+                    push_error("At pipeline step " + std::to_string(current_line) + ": Oversampling factor " + value + " is not supported, use 2, 4 or 8");
+                    return;
+                } else if (key == "loop" && !value.empty()) {
+                    loop = value;
+                } else if (key == "loop") {
+                    push_error("At pipeline step " + std::to_string(current_line) + ": Feedback loops need a name, e.g. loop=comb");
+                    return;
+                } else {
+                    push_error("At pipeline step " + std::to_string(current_line) + ": Unknown option " + key);
+                    return;
+                }
+            }
+            if (control_rate && oversampling > 1) {
+                push_error("At pipeline step " + std::to_string(current_line) + ": Control rate steps can not be oversampled");
+                return;
+            }
+        }
+
+        auto generator_type                {std::string {splited_line[0].text}};
+        auto const& input_parameters_raw  {splited_line[1]};
+        auto const& output_parameters_raw {splited_line[2]};
 
         // These two values should be surrounded by parentheses, so check size accordingly.
         auto bad_inputs_outputs {false};
-        if (input_parameters_raw.size() < 3 || input_parameters_raw[0] != '(' || input_parameters_raw[input_parameters_raw.size() - 1] != ')') {
-            msg_box.push_error("At pipeline step " + std::to_string(current_line) + ": Inputs need to be surrounded by parentheses");
+        if (input_parameters_raw.text.size() < 3 || input_parameters_raw.text.front() != '(' || input_parameters_raw.text.back() != ')') {
+            push_error("At pipeline step " + std::to_string(current_line) + ": Inputs need to be surrounded by parentheses");
             bad_inputs_outputs = true;
         }
-        if (output_parameters_raw.size() < 3 || output_parameters_raw[0] != '(' || output_parameters_raw[output_parameters_raw.size() - 1] != ')') {
-            msg_box.push_error("At pipeline step " + std::to_string(current_line) + ": Outputs need to be surrounded by parentheses");
+        if (output_parameters_raw.text.size() < 3 || output_parameters_raw.text.front() != '(' || output_parameters_raw.text.back() != ')') {
+            push_error("At pipeline step " + std::to_string(current_line) + ": Outputs need to be surrounded by parentheses");
             bad_inputs_outputs = true;
         }
         if (bad_inputs_outputs) {
             return;
         }
 
-        // Remove parentheses.
-        input_parameters_raw  = input_parameters_raw.substr  (1, input_parameters_raw.size()  - 2);
-        output_parameters_raw = output_parameters_raw.substr (1, output_parameters_raw.size() - 2);
-
         payload->pipeline_section.push_back({});
         payload->pipeline_section.back().generator_type = generator_type;
+        payload->pipeline_section.back().voice_pool = voice_pool;
+        payload->pipeline_section.back().control_rate = control_rate;
+        payload->pipeline_section.back().control_interpolation = control_interpolation;
+        payload->pipeline_section.back().oversampling = oversampling;
+        payload->pipeline_section.back().loop = loop;
 
-        auto input_parameter_list_raw {parse_whitespace_separated_values(input_parameters_raw)};
+        auto input_parameter_list_raw {parse_whitespace_separated_values(strip_enclosing(input_parameters_raw))};
         auto& input_parameter_list {payload->pipeline_section.back().input_parameters};
-        std::transform(std::begin(input_parameter_list_raw), std::end(input_parameter_list_raw), std::back_inserter(input_parameter_list), [](std::string const& input_parameter_raw){
+        std::transform(std::begin(input_parameter_list_raw), std::end(input_parameter_list_raw), std::back_inserter(input_parameter_list), [](text_token const& input_parameter_token){
+            auto const& input_parameter_raw {input_parameter_token.text};
             pipeline_step_input_parameter param;
+            param.is_trigger = false;
             if (input_parameter_raw[0] == '#' && input_parameter_raw.size() >= 2) {
                 param.is_buffer = true;
                 param.buffer_id = parse_unsigned_int(input_parameter_raw.substr(1));
+            } else if (input_parameter_raw == "note" || input_parameter_raw == "velocity" || input_parameter_raw == "gate") {
+                param.is_buffer = false;
+                param.is_trigger = true;
+                param.trigger = input_parameter_raw == "note"     ? audio_pipeline::voice_trigger::note
+                              : input_parameter_raw == "velocity" ? audio_pipeline::voice_trigger::velocity
+                              :                                     audio_pipeline::voice_trigger::gate;
             } else {
                 param.is_buffer = false;
                 param.value = parse_float(input_parameter_raw);
@@ -192,118 +430,1644 @@ std::unique_ptr<audio_process> load_pipeline_from_file(std::unique_ptr<audio_pro
             return param;
         });
 
-        auto output_buffer_list_raw {parse_whitespace_separated_values(output_parameters_raw)};
+        // The built-in bus takes its inputs as pairs of a source and its gain, any number of them.
+        if (generator_type == "bus" && (input_parameter_list.empty() || input_parameter_list.size() % 2 != 0)) {
+            push_error("At pipeline step " + std::to_string(current_line) + ": Bus inputs need to be pairs of a source and a gain");
+        }
+
+        for (auto const& param : input_parameter_list) {
+            if (param.is_trigger && voice_pool.empty()) {
+                push_error("At pipeline step " + std::to_string(current_line) + ": Note, velocity and gate inputs are only available to voice steps");
+                break;
+            }
+        }
+
+        auto output_buffer_list_raw {parse_whitespace_separated_values(strip_enclosing(output_parameters_raw))};
         auto& output_buffer_list {payload->pipeline_section.back().output_parameters};
-        std::for_each(std::begin(output_buffer_list_raw), std::end(output_buffer_list_raw), [&](std::string const& output_parameter_raw){
+        std::for_each(std::begin(output_buffer_list_raw), std::end(output_buffer_list_raw), [&](text_token const& output_parameter_token){
+            auto const& output_parameter_raw {output_parameter_token.text};
             pipeline_step_output_parameter param;
             if (output_parameter_raw[0] == '#' && output_parameter_raw.size() >= 2) {
                 param.buffer_id = parse_unsigned_int(output_parameter_raw.substr(1));
                 output_buffer_list.push_back(param);
             }
         });
+
+        if (!voice_pool.empty()) {
+            auto pool {find_voice_pool(*payload, voice_pool)};
+            for (auto const& param : output_buffer_list) {
+                pool->private_buffer_ids.insert(param.buffer_id);
+            }
+        }
+    });
+
+    // Steps of a feedback loop run one sample at a time as one unit, so they need to be consecutive.
+    std::set<std::string> closed_loops;
+    current_line = 0;
+    for (unsigned int i {0}; i < payload->pipeline_section.size(); ++i) {
+        ++current_line;
+        auto const& loop {payload->pipeline_section[i].loop};
+        if (i > 0 && payload->pipeline_section[i - 1].loop != loop && !payload->pipeline_section[i - 1].loop.empty()) {
+            closed_loops.insert(payload->pipeline_section[i - 1].loop);
+        }
+        if (!loop.empty() && closed_loops.find(loop) != closed_loops.end()) {
+            push_error("At pipeline step " + std::to_string(current_line) + ": Feedback loop " + loop + " is split by steps outside of it");
+        }
+    }
+
+    std::for_each(std::begin(feedback_lines), std::end(feedback_lines), [&](text_token const& line) {
+        auto splited_line {parse_whitespace_separated_values(line)};
+
+        // Line format: <buffer id>
+        if (splited_line.size() != 1) {
+            push_error(position_of(line) + ": Feedback buffers need to be defined by a buffer id alone");
+            return;
+        }
+        payload->feedback_buffer_ids.insert(parse_unsigned_int(splited_line[0].text));
     });
 
-    std::for_each(std::begin(output_lines), std::end(output_lines), [&](std::string const& line) {
+    // Voice private buffers only exist inside their voices, nothing else may refer to them.
+    std::map<unsigned int, std::string> private_buffer_owners;
+    for (auto const& pool : payload->voice_section) {
+        if (pool.private_buffer_ids.find(pool.output_buffer_id) == pool.private_buffer_ids.end()) {
+            push_error("Voice pool " + pool.name + ": Voice output buffer #" + std::to_string(pool.output_buffer_id) + " is not written by any of its steps");
+        }
+        for (auto buffer_id : pool.private_buffer_ids) {
+            if (private_buffer_owners.find(buffer_id) != private_buffer_owners.end() || buffer_id == pool.mix_buffer_id) {
+                push_error("Voice pool " + pool.name + ": Buffer #" + std::to_string(buffer_id) + " is shared with steps outside of the pool");
+            }
+            private_buffer_owners[buffer_id] = pool.name;
+        }
+    }
+    current_line = 0;
+    for (auto const& step : payload->pipeline_section) {
+        ++current_line;
+        auto check_buffer {[&](unsigned int buffer_id) {
+            auto owner_iter {private_buffer_owners.find(buffer_id)};
+            if (owner_iter != private_buffer_owners.end() && owner_iter->second != step.voice_pool) {
+                push_error("At pipeline step " + std::to_string(current_line) + ": Buffer #" + std::to_string(buffer_id) + " belongs to the voices of " + owner_iter->second);
+            }
+        }};
+        for (auto const& param : step.input_parameters) {
+            if (param.is_buffer) {
+                check_buffer(param.buffer_id);
+            }
+        }
+        for (auto const& param : step.output_parameters) {
+            check_buffer(param.buffer_id);
+        }
+    }
+
+    std::for_each(std::begin(output_lines), std::end(output_lines), [&](text_token const& line) {
         auto splited_line {parse_whitespace_separated_values(line)};
 
         // Line format: <channel name> <buffer id>
         if (splited_line.size() != 2) {
-            msg_box.push_error("Outputs need to be defined by a channel name and a buffer id");
+            push_error(position_of(line) + ": Outputs need to be defined by a channel name and a buffer id");
             return;
         }
 
-        auto& channel_name  {splited_line[0]};
-        auto& buffer_id_raw {splited_line[1]};
+        auto channel_name         {std::string {splited_line[0].text}};
+        auto const& buffer_id_raw {splited_line[1].text};
 
         auto buffer_id {parse_unsigned_int(buffer_id_raw)};
 
+        if (private_buffer_owners.find(buffer_id) != private_buffer_owners.end()) {
+            push_error("Output channel " + channel_name + ": Buffer #" + std::to_string(buffer_id) + " belongs to the voices of " + private_buffer_owners[buffer_id]);
+            return;
+        }
+
         payload->output_section.push_back({channel_name, buffer_id});
     });
 
-    if (msg_box.length() > 0) {
+    std::for_each(std::begin(input_lines), std::end(input_lines), [&](text_token const& line) {
+        auto splited_line {parse_whitespace_separated_values(line)};
+
+        // Line format: <channel name> <buffer id>
+        if (splited_line.size() != 2) {
+            push_error(position_of(line) + ": Inputs need to be defined by a channel name and a buffer id");
+            return;
+        }
+
+        auto channel_name         {std::string {splited_line[0].text}};
+        auto const& buffer_id_raw {splited_line[1].text};
+
+        if (channel_name != "left" && channel_name != "right") {
+            push_error("Input channel " + channel_name + " does not exist, use left or right");
+            return;
+        }
+
+        auto buffer_id {parse_unsigned_int(buffer_id_raw)};
+
+        // Input buffers are overwritten by the audio process before every block, so they are read-only to the pipeline.
+        auto step_number {0};
+        for (auto const& step : payload->pipeline_section) {
+            ++step_number;
+            for (auto const& param : step.output_parameters) {
+                if (param.buffer_id == buffer_id) {
+                    push_error("At pipeline step " + std::to_string(step_number) + ": Buffer #" + std::to_string(buffer_id) + " is the " + channel_name + " input channel and cannot be written to");
+                }
+            }
+        }
+
+        payload->input_section.push_back({channel_name, buffer_id});
+    });
+
+    if (error_count > 0) {
         delete payload;
-        return aprocess;
+        return nullptr;
     }
 
     std::for_each(std::begin(payload->pipeline_section), std::end(payload->pipeline_section), [&](pipeline_section_step const& step){
         for (auto const& param: step.input_parameters) {
-            if (param.is_buffer) {
+            if (param.is_buffer && private_buffer_owners.find(param.buffer_id) == private_buffer_owners.end()) {
                 payload->buffer_id_to_handle[param.buffer_id] = {};
             }
         }
         for (auto const& param: step.output_parameters) {
-            payload->buffer_id_to_handle[param.buffer_id] = {};
+            if (private_buffer_owners.find(param.buffer_id) == private_buffer_owners.end()) {
+                payload->buffer_id_to_handle[param.buffer_id] = {};
+            }
         }
     });
+    for (auto const& pool : payload->voice_section) {
+        payload->buffer_id_to_handle[pool.mix_buffer_id] = {};
+    }
+    for (auto const& step : payload->input_section) {
+        payload->buffer_id_to_handle[step.buffer_id] = {};
+    }
 
-    // =====================================================================
-    // ======================== Transform pipeline =========================
-    // =====================================================================
-    aprocess->configure(static_cast<void*>(payload), [](audio_process::configurer& process_configurer, void* p){
-        auto payload {static_cast<pipeline_config_payload*>(p)};
-        auto& pipeline {process_configurer.get_pipeline()};
+    return payload;
+}
+
+// =====================================================================
+// ========================= Compiled pipelines ========================
+// =====================================================================
+// A compiled pipeline holds a parsed and checked config: the steps with their port bindings, the
+// voice pools, channels and buffer ids, and the paths of the generator sources and of the object
+// files they were compiled to. The config, every generator source and every object are stored with
+// their hash, the compiled pipeline is stale as soon as one of them differs. The steps as optimised
+// for the default audio config follow. Numbers are stored as they are in memory, so compiled
+// pipelines only move between machines of the same byte order.
+struct compiled_writer {
+    void write_uint(unsigned int value) {
+        bytes.append(reinterpret_cast<char const*>(&value), sizeof(value));
+    }
+
+    void write_hash(unsigned long long value) {
+        bytes.append(reinterpret_cast<char const*>(&value), sizeof(value));
+    }
+
+    void write_string(std::string_view value) {
+        write_uint(static_cast<unsigned int>(value.size()));
+        bytes.append(value);
+    }
+
+    std::string bytes;
+};
 
-        for (auto& id_to_handle : payload->buffer_id_to_handle) {
-            id_to_handle.second = pipeline.add_buffer();
+// Reads past the end or counts larger than what is left fail the reader, and everything read after
+// that is zero or empty.
+struct compiled_reader {
+    bool read_bytes(void* destination, size_t count) {
+        if (failed || count > bytes.size() - position) {
+            failed = true;
+            return false;
         }
+        std::memcpy(destination, bytes.data() + position, count);
+        position += count;
+        return true;
+    }
 
-        for (auto const& generator_type : payload->generator_section) {
-            auto handle {pipeline.add_generator_type(generator_type.generator_code)};
-            if (pipeline.generator_type_is_valid(handle)) {
-                auto const& generator_interface {pipeline.get_generator_interface(handle)};
-                auto type_id {generator_interface.id()};
-                payload->generator_type_id_to_impl[type_id] = handle;
-            }
+    unsigned int read_uint() {
+        unsigned int value {0};
+        read_bytes(&value, sizeof(value));
+        return value;
+    }
+
+    unsigned long long read_hash() {
+        unsigned long long value {0};
+        read_bytes(&value, sizeof(value));
+        return value;
+    }
+
+    unsigned int read_count() {
+        auto count {read_uint()};
+        if (count > bytes.size() - position) {
+            failed = true;
+            return 0;
         }
+        return count;
+    }
 
-        for (auto const& step : payload->pipeline_section) {
-            auto it {payload->generator_type_id_to_impl.find(step.generator_type)};
-            if (it == payload->generator_type_id_to_impl.end()) {
-                continue;
+    std::string read_string() {
+        auto length {read_count()};
+        if (failed) {
+            return {};
+        }
+        position += length;
+        return std::string {bytes.substr(position - length, length)};
+    }
+
+    std::string_view bytes;
+    size_t position {0};
+    bool failed {false};
+};
+
+const std::string_view COMPILED_PIPELINE_MAGIC {"BZZTPIPE"};
+
+// Compiled pipelines of any other version are ignored, and their config parsed again.
+const unsigned int COMPILED_PIPELINE_VERSION {2};
+
+// Input bindings are stored as their kind followed by the buffer id, the bits of the value or the trigger.
+const unsigned int COMPILED_INPUT_VALUE   {0};
+const unsigned int COMPILED_INPUT_BUFFER  {1};
+const unsigned int COMPILED_INPUT_TRIGGER {2};
+
+// 64 bit FNV-1a.
+unsigned long long hash_contents(std::string_view contents) {
+    unsigned long long hash {14695981039346656037ull};
+    for (auto c : contents) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string get_compiled_pipeline_path(std::string const& path) {
+    return path + ".compiled";
+}
+
+std::string get_compiled_object_path(std::string const& path, unsigned int generator_index) {
+    return get_compiled_pipeline_path(path) + "." + std::to_string(generator_index) + ".o";
+}
+
+void write_input_binding(compiled_writer& writer, audio_pipeline::input_binding const& binding) {
+    if (binding.is_trigger) {
+        writer.write_uint(COMPILED_INPUT_TRIGGER);
+        writer.write_uint(static_cast<unsigned int>(binding.trigger));
+    } else if (binding.is_buffer) {
+        writer.write_uint(COMPILED_INPUT_BUFFER);
+        writer.write_uint(binding.buffer);
+    } else {
+        unsigned int bits {0};
+        std::memcpy(&bits, &binding.value, sizeof(bits));
+        writer.write_uint(COMPILED_INPUT_VALUE);
+        writer.write_uint(bits);
+    }
+}
+
+audio_pipeline::input_binding read_input_binding(compiled_reader& reader) {
+    audio_pipeline::input_binding binding {};
+    auto kind {reader.read_uint()};
+    auto bits {reader.read_uint()};
+    binding.is_buffer = kind == COMPILED_INPUT_BUFFER;
+    binding.is_trigger = kind == COMPILED_INPUT_TRIGGER;
+    if (binding.is_trigger) {
+        binding.trigger = static_cast<audio_pipeline::voice_trigger>(bits);
+    } else if (binding.is_buffer) {
+        binding.buffer = bits;
+    } else {
+        std::memcpy(&binding.value, &bits, sizeof(bits));
+    }
+    return binding;
+}
+
+std::string write_compiled_pipeline(pipeline_config_payload const& payload, optimised_pipeline_section const& optimised, unsigned long long config_hash) {
+    compiled_writer writer {};
+    writer.bytes.append(COMPILED_PIPELINE_MAGIC);
+    writer.write_uint(COMPILED_PIPELINE_VERSION);
+    writer.write_hash(config_hash);
+
+    writer.write_uint(payload.generator_section.size());
+    for (auto const& generator : payload.generator_section) {
+        writer.write_string(generator.path);
+        writer.write_hash(hash_contents(generator.generator_code));
+        mapped_file object_file {generator.object_path};
+        writer.write_string(generator.object_path);
+        writer.write_hash(hash_contents(object_file.contents()));
+    }
+
+    writer.write_uint(payload.voice_section.size());
+    for (auto const& pool : payload.voice_section) {
+        writer.write_string(pool.name);
+        writer.write_uint(pool.voice_count);
+        writer.write_uint(static_cast<unsigned int>(pool.policy));
+        writer.write_uint(pool.output_buffer_id);
+        writer.write_uint(pool.mix_buffer_id);
+        writer.write_uint(pool.private_buffer_ids.size());
+        for (auto buffer_id : pool.private_buffer_ids) {
+            writer.write_uint(buffer_id);
+        }
+    }
+
+    writer.write_uint(payload.pipeline_section.size());
+    for (auto const& step : payload.pipeline_section) {
+        writer.write_string(step.generator_type);
+        writer.write_uint(step.input_parameters.size());
+        for (auto const& param : step.input_parameters) {
+            if (param.is_trigger) {
+                writer.write_uint(COMPILED_INPUT_TRIGGER);
+                writer.write_uint(static_cast<unsigned int>(param.trigger));
+            } else if (param.is_buffer) {
+                writer.write_uint(COMPILED_INPUT_BUFFER);
+                writer.write_uint(param.buffer_id);
+            } else {
+                unsigned int bits {0};
+                std::memcpy(&bits, &param.value, sizeof(bits));
+                writer.write_uint(COMPILED_INPUT_VALUE);
+                writer.write_uint(bits);
             }
-            auto generator_type {it->second};
+        }
+        writer.write_uint(step.output_parameters.size());
+        for (auto const& param : step.output_parameters) {
+            writer.write_uint(param.buffer_id);
+        }
+        writer.write_string(step.voice_pool);
+        writer.write_uint(step.control_rate ? 1 : 0);
+        writer.write_uint(static_cast<unsigned int>(step.control_interpolation));
+        writer.write_uint(step.oversampling);
+        writer.write_string(step.loop);
+    }
 
-            auto const& generator_interface {pipeline.get_generator_interface(it->second)};
-            if (step.input_parameters.size() != generator_interface.input_count() || step.output_parameters.size() != generator_interface.output_count()) {
-                continue;
+    writer.write_uint(payload.output_section.size());
+    for (auto const& step : payload.output_section) {
+        writer.write_string(step.channel_name);
+        writer.write_uint(step.buffer_id);
+    }
+
+    writer.write_uint(payload.input_section.size());
+    for (auto const& step : payload.input_section) {
+        writer.write_string(step.channel_name);
+        writer.write_uint(step.buffer_id);
+    }
+
+    writer.write_uint(payload.feedback_buffer_ids.size());
+    for (auto buffer_id : payload.feedback_buffer_ids) {
+        writer.write_uint(buffer_id);
+    }
+
+    writer.write_uint(payload.buffer_id_to_handle.size());
+    for (auto const& id_to_handle : payload.buffer_id_to_handle) {
+        writer.write_uint(id_to_handle.first);
+    }
+
+    writer.write_uint(optimised.config.buffer_size);
+    writer.write_uint(optimised.config.sample_rate);
+    writer.write_uint(optimised.steps.size());
+    for (unsigned int i {0}; i < optimised.steps.size(); ++i) {
+        auto const& step {optimised.steps[i]};
+        writer.write_string(optimised.step_types[i]);
+        writer.write_uint(step.inputs.size());
+        for (auto const& binding : step.inputs) {
+            write_input_binding(writer, binding);
+        }
+        writer.write_uint(step.outputs.size());
+        for (auto buffer : step.outputs) {
+            writer.write_uint(buffer);
+        }
+        writer.write_uint(step.control_rate ? 1 : 0);
+        writer.write_uint(static_cast<unsigned int>(step.interpolation));
+        writer.write_uint(step.oversampling);
+        writer.write_uint(step.in_voice ? 1 : 0);
+        writer.write_uint(step.voice_pool);
+        writer.write_uint(step.voice);
+    }
+    writer.write_uint(optimised.loops.size());
+    for (auto const& loop : optimised.loops) {
+        writer.write_uint(std::get<0>(loop));
+        writer.write_uint(std::get<1>(loop));
+    }
+    writer.write_uint(optimised.constant_buffers.size());
+    for (auto const& constant : optimised.constant_buffers) {
+        unsigned int bits {0};
+        std::memcpy(&bits, &std::get<1>(constant), sizeof(bits));
+        writer.write_uint(std::get<0>(constant));
+        writer.write_uint(bits);
+    }
+
+    return writer.bytes;
+}
+
+// Returns null when there is no compiled pipeline for the config at path, or it is of another
+// version, stale or damaged. The config is parsed as usual then.
+pipeline_config_payload* read_compiled_pipeline(std::string const& path) {
+    mapped_file compiled_file {get_compiled_pipeline_path(path)};
+    compiled_reader reader {compiled_file.contents()};
+    if (reader.bytes.substr(0, COMPILED_PIPELINE_MAGIC.size()) != COMPILED_PIPELINE_MAGIC) {
+        return nullptr;
+    }
+    reader.position = COMPILED_PIPELINE_MAGIC.size();
+    if (reader.read_uint() != COMPILED_PIPELINE_VERSION) {
+        return nullptr;
+    }
+
+    mapped_file config_file {path};
+    if (reader.read_hash() != hash_contents(config_file.contents())) {
+        return nullptr;
+    }
+
+    auto payload {std::make_unique<pipeline_config_payload>()};
+    auto generator_count {reader.read_count()};
+    std::vector<std::string> generator_paths {};
+    std::vector<unsigned long long> generator_hashes {};
+    std::vector<std::string> object_paths {};
+    for (unsigned int i {0}; i < generator_count && !reader.failed; ++i) {
+        generator_paths.push_back(reader.read_string());
+        generator_hashes.push_back(reader.read_hash());
+        object_paths.push_back(reader.read_string());
+        mapped_file object_file {object_paths.back()};
+        if (object_file.contents().empty() || reader.read_hash() != hash_contents(object_file.contents())) {
+            return nullptr;
+        }
+    }
+    auto generator_codes {read_generator_files(generator_paths)};
+    for (unsigned int i {0}; i < generator_paths.size(); ++i) {
+        if (generator_codes[i].empty() || generator_hashes[i] != hash_contents(generator_codes[i])) {
+            return nullptr;
+        }
+        payload->generator_section.push_back({std::move(generator_codes[i]), generator_paths[i], nullptr, {}, object_paths[i]});
+    }
+
+    auto voice_pool_count {reader.read_count()};
+    for (unsigned int i {0}; i < voice_pool_count && !reader.failed; ++i) {
+        voice_section_step pool {};
+        pool.name = reader.read_string();
+        pool.voice_count = reader.read_uint();
+        pool.policy = static_cast<audio_pipeline::voice_steal_policy>(reader.read_uint());
+        pool.output_buffer_id = reader.read_uint();
+        pool.mix_buffer_id = reader.read_uint();
+        auto private_count {reader.read_count()};
+        for (unsigned int k {0}; k < private_count && !reader.failed; ++k) {
+            pool.private_buffer_ids.insert(reader.read_uint());
+        }
+        payload->voice_section.push_back(std::move(pool));
+    }
+
+    auto step_count {reader.read_count()};
+    for (unsigned int i {0}; i < step_count && !reader.failed; ++i) {
+        pipeline_section_step step {};
+        step.generator_type = reader.read_string();
+        auto input_count {reader.read_count()};
+        for (unsigned int k {0}; k < input_count && !reader.failed; ++k) {
+            pipeline_step_input_parameter param {};
+            auto kind {reader.read_uint()};
+            auto bits {reader.read_uint()};
+            param.is_buffer = kind == COMPILED_INPUT_BUFFER;
+            param.is_trigger = kind == COMPILED_INPUT_TRIGGER;
+            if (param.is_trigger) {
+                param.trigger = static_cast<audio_pipeline::voice_trigger>(bits);
+            } else if (param.is_buffer) {
+                param.buffer_id = bits;
+            } else {
+                std::memcpy(&param.value, &bits, sizeof(bits));
             }
+            step.input_parameters.push_back(param);
+        }
+        auto output_count {reader.read_count()};
+        for (unsigned int k {0}; k < output_count && !reader.failed; ++k) {
+            step.output_parameters.push_back({reader.read_uint()});
+        }
+        step.voice_pool = reader.read_string();
+        step.control_rate = reader.read_uint() != 0;
+        step.control_interpolation = static_cast<audio_pipeline::control_interpolation>(reader.read_uint());
+        step.oversampling = reader.read_uint();
+        step.loop = reader.read_string();
+        payload->pipeline_section.push_back(std::move(step));
+    }
+
+    auto output_count {reader.read_count()};
+    for (unsigned int i {0}; i < output_count && !reader.failed; ++i) {
+        auto channel_name {reader.read_string()};
+        payload->output_section.push_back({channel_name, reader.read_uint()});
+    }
 
-            auto generator = pipeline.add_generator_back(generator_type);
+    auto input_count {reader.read_count()};
+    for (unsigned int i {0}; i < input_count && !reader.failed; ++i) {
+        auto channel_name {reader.read_string()};
+        payload->input_section.push_back({channel_name, reader.read_uint()});
+    }
 
-            for (unsigned int i {0}; i < step.input_parameters.size(); ++i) {
-                auto input_param {step.input_parameters[i]};
-                if (input_param.is_buffer) {
-                    auto buffer_handle {payload->buffer_id_to_handle[input_param.buffer_id]};
-                    pipeline.set_generator_input_buffer(generator, i, buffer_handle);
-                } else {
-                    pipeline.set_generator_input_value(generator, i, input_param.value);
+    auto feedback_count {reader.read_count()};
+    for (unsigned int i {0}; i < feedback_count && !reader.failed; ++i) {
+        payload->feedback_buffer_ids.insert(reader.read_uint());
+    }
+
+    auto buffer_count {reader.read_count()};
+    for (unsigned int i {0}; i < buffer_count && !reader.failed; ++i) {
+        payload->buffer_id_to_handle[reader.read_uint()] = {};
+    }
+
+    auto optimised {std::make_unique<optimised_pipeline_section>()};
+    optimised->config.buffer_size = reader.read_uint();
+    optimised->config.sample_rate = reader.read_uint();
+    auto optimised_count {reader.read_count()};
+    for (unsigned int i {0}; i < optimised_count && !reader.failed; ++i) {
+        audio_pipeline::step_description step {};
+        optimised->step_types.push_back(reader.read_string());
+        auto input_count {reader.read_count()};
+        for (unsigned int k {0}; k < input_count && !reader.failed; ++k) {
+            step.inputs.push_back(read_input_binding(reader));
+        }
+        auto output_count {reader.read_count()};
+        for (unsigned int k {0}; k < output_count && !reader.failed; ++k) {
+            step.outputs.push_back(reader.read_uint());
+        }
+        step.control_rate = reader.read_uint() != 0;
+        step.interpolation = static_cast<audio_pipeline::control_interpolation>(reader.read_uint());
+        step.oversampling = reader.read_uint();
+        step.in_voice = reader.read_uint() != 0;
+        step.voice_pool = reader.read_uint();
+        step.voice = reader.read_uint();
+        optimised->steps.push_back(std::move(step));
+    }
+    auto loop_count {reader.read_count()};
+    for (unsigned int i {0}; i < loop_count && !reader.failed; ++i) {
+        auto first {reader.read_uint()};
+        optimised->loops.push_back({first, reader.read_uint()});
+    }
+    auto constant_count {reader.read_count()};
+    for (unsigned int i {0}; i < constant_count && !reader.failed; ++i) {
+        auto buffer {reader.read_uint()};
+        auto bits {reader.read_uint()};
+        float value {0.0f};
+        std::memcpy(&value, &bits, sizeof(bits));
+        optimised->constant_buffers.push_back({buffer, value});
+    }
+    payload->optimised = std::move(optimised);
+
+    if (reader.failed || reader.position != reader.bytes.size()) {
+        return nullptr;
+    }
+    return payload.release();
+}
+
+const audio_pipeline::generator_type_handle INVALID_GENERATOR_TYPE_HANDLE {UINT_MAX};
+
+// Buffers of every voice of every pool by buffer id, each voice has its own copy of the buffers
+// written by the steps of its pool.
+using voice_buffer_map = std::map<std::string, std::vector<std::map<unsigned int, audio_pipeline::buffer_handle>>>;
+
+void add_voice_pools(audio_pipeline& pipeline, pipeline_config_payload const& payload, std::map<unsigned int, audio_pipeline::buffer_handle>& buffer_id_to_handle, std::map<std::string, audio_pipeline::voice_pool_handle>& voice_pools, voice_buffer_map& voice_buffers) {
+    for (auto const& pool : payload.voice_section) {
+        auto pool_handle {pipeline.add_voice_pool(pool.policy, buffer_id_to_handle[pool.mix_buffer_id])};
+        voice_pools[pool.name] = pool_handle;
+        auto& buffers {voice_buffers[pool.name]};
+        buffers.resize(pool.voice_count);
+        for (auto& voice_buffer_id_to_handle : buffers) {
+            auto private_handles {pipeline.add_buffers(pool.private_buffer_ids.size())};
+            auto private_handle_iter {std::begin(private_handles)};
+            for (auto buffer_id : pool.private_buffer_ids) {
+                voice_buffer_id_to_handle[buffer_id] = *private_handle_iter++;
+                if (payload.feedback_buffer_ids.find(buffer_id) != payload.feedback_buffer_ids.end()) {
+                    pipeline.set_buffer_feedback(voice_buffer_id_to_handle[buffer_id], true);
                 }
             }
+            pipeline.add_voice(pool_handle, voice_buffer_id_to_handle[pool.output_buffer_id]);
+        }
+    }
+}
 
-            for (unsigned int i {0}; i < step.output_parameters.size(); ++i) {
-                auto output_param {step.output_parameters[i]};
-                auto buffer_handle {payload->buffer_id_to_handle[output_param.buffer_id]};
-                pipeline.set_generator_output_buffer(generator, i, buffer_handle);
-            }
+// Type the step runs, found in types by type_name. Invalid when there is none or its port counts
+// differ from the parameters of the step.
+audio_pipeline::generator_type_handle find_step_type(audio_pipeline& pipeline, pipeline_section_step const& step, std::map<std::string, audio_pipeline::generator_type_handle> const& types, std::string const& type_name) {
+    // Bus steps always use the built-in bus for their number of sources.
+    auto generator_type {INVALID_GENERATOR_TYPE_HANDLE};
+    if (step.generator_type == "bus") {
+        generator_type = pipeline.add_bus_type(step.input_parameters.size() / 2);
+    } else {
+        auto it {types.find(type_name)};
+        if (it != types.end()) {
+            generator_type = it->second;
         }
+    }
 
-        for (auto const& step: payload->output_section) {
-            if (payload->buffer_id_to_handle.find(step.buffer_id) == payload->buffer_id_to_handle.end()) {
-                continue;
-            }
+    if (!pipeline.generator_type_is_valid(generator_type)) {
+        return INVALID_GENERATOR_TYPE_HANDLE;
+    }
+    if (step.input_parameters.size() != pipeline.get_generator_input_count(generator_type) || step.output_parameters.size() != pipeline.get_generator_output_count(generator_type)) {
+        return INVALID_GENERATOR_TYPE_HANDLE;
+    }
+    return generator_type;
+}
 
-            if (step.channel_name == "left") {
-                process_configurer.set_left_channel_buffer(payload->buffer_id_to_handle[step.buffer_id]);
-            } else if (step.channel_name == "right") {
-                process_configurer.set_right_channel_buffer(payload->buffer_id_to_handle[step.buffer_id]);
+// The copy of step run by voice, all of it for steps outside voice pools, with buffer ids resolved.
+audio_pipeline::step_description describe_step(pipeline_section_step const& step, audio_pipeline::generator_type_handle generator_type, unsigned int voice, std::map<unsigned int, audio_pipeline::buffer_handle>& buffer_id_to_handle, std::map<std::string, audio_pipeline::voice_pool_handle>& voice_pools, voice_buffer_map& voice_buffers) {
+    auto resolve_buffer {[&](unsigned int buffer_id) {
+        if (!step.voice_pool.empty()) {
+            auto const& voice_buffer_id_to_handle {voice_buffers[step.voice_pool][voice]};
+            auto private_iter {voice_buffer_id_to_handle.find(buffer_id)};
+            if (private_iter != voice_buffer_id_to_handle.end()) {
+                return private_iter->second;
             }
         }
-    }, [](void *p){
-        auto payload {static_cast<pipeline_config_payload*>(p)};
-        delete payload;
-    });
+        return buffer_id_to_handle[buffer_id];
+    }};
 
-    return aprocess;
+    audio_pipeline::step_description description {};
+    description.type = generator_type;
+    if (!step.voice_pool.empty()) {
+        description.in_voice = true;
+        description.voice_pool = voice_pools[step.voice_pool];
+        description.voice = voice;
+    }
+    description.control_rate = step.control_rate;
+    description.interpolation = step.control_interpolation;
+    description.oversampling = step.oversampling;
+
+    for (auto const& input_param : step.input_parameters) {
+        audio_pipeline::input_binding binding {};
+        if (input_param.is_trigger) {
+            binding.is_trigger = true;
+            binding.trigger = input_param.trigger;
+        } else if (input_param.is_buffer) {
+            binding.is_buffer = true;
+            binding.buffer = resolve_buffer(input_param.buffer_id);
+        } else {
+            binding.value = input_param.value;
+        }
+        description.inputs.push_back(binding);
+    }
+
+    for (auto const& output_param : step.output_parameters) {
+        description.outputs.push_back(resolve_buffer(output_param.buffer_id));
+    }
+    return description;
+}
+
+// Output channel buffers, the ones optimising keeps alive.
+std::vector<audio_pipeline::buffer_handle> find_live_buffers(pipeline_config_payload const& payload) {
+    std::vector<audio_pipeline::buffer_handle> live_buffers {};
+    for (auto const& step: payload.output_section) {
+        auto handle_iter {payload.buffer_id_to_handle.find(step.buffer_id)};
+        if (handle_iter != payload.buffer_id_to_handle.end()) {
+            live_buffers.push_back(handle_iter->second);
+        }
+    }
+    return live_buffers;
+}
+
+// Output channels lagging behind the start of the pipeline by the latency their generators report.
+void report_output_latencies(audio_pipeline& pipeline, pipeline_config_payload const& payload) {
+    for (auto const& step : payload.output_section) {
+        auto handle_iter {payload.buffer_id_to_handle.find(step.buffer_id)};
+        if (handle_iter == payload.buffer_id_to_handle.end()) {
+            continue;
+        }
+        auto latency {pipeline.get_buffer_latency(handle_iter->second)};
+        if (latency > 0) {
+            payload.msg_box->push_info("Output channel " + step.channel_name + " is " + std::to_string(latency) + " samples late, the latency its generators report");
+        }
+    }
+}
+
+// Adds the steps optimised when the pipeline was compiled. The buffers and voice pools added before
+// got the same handles they had then.
+void add_optimised_steps(audio_pipeline& pipeline, pipeline_config_payload& payload) {
+    auto& optimised {*payload.optimised};
+    for (unsigned int i {0}; i < optimised.steps.size(); ++i) {
+        auto& step {optimised.steps[i]};
+        auto type_iter {payload.generator_type_id_to_impl.find(optimised.step_types[i])};
+        if (optimised.step_types[i] == "bus") {
+            step.type = pipeline.add_bus_type(step.inputs.size() / 2);
+        } else {
+            step.type = type_iter != payload.generator_type_id_to_impl.end() ? type_iter->second : INVALID_GENERATOR_TYPE_HANDLE;
+        }
+    }
+
+    auto generators {pipeline.add_generators_back(optimised.steps)};
+    if (generators.size() != optimised.steps.size()) {
+        payload.msg_box->push_error("The pipeline steps could not be added to the audio pipeline");
+        return;
+    }
+    for (auto const& loop : optimised.loops) {
+        auto first {std::get<0>(loop)};
+        auto last {std::get<1>(loop)};
+        if (first < generators.size() && last < generators.size()) {
+            pipeline.add_feedback_loop(generators[first], generators[last]);
+        }
+    }
+
+    auto live_buffers {find_live_buffers(payload)};
+    for (auto const& constant : optimised.constant_buffers) {
+        auto buffer {std::get<0>(constant)};
+        if (std::find(std::begin(live_buffers), std::end(live_buffers), buffer) != std::end(live_buffers)) {
+            pipeline.set_buffer(buffer, std::vector<float>(pipeline.get_audio_config().buffer_size, std::get<1>(constant)));
+        }
+    }
+}
+
+// The steps of an optimised pipeline, to be stored in a compiled pipeline.
+optimised_pipeline_section describe_optimised_pipeline(audio_pipeline const& pipeline, pipeline_config_payload const& payload) {
+    optimised_pipeline_section optimised {pipeline.get_audio_config(), {}, pipeline.describe_steps(), pipeline.get_feedback_loop_positions(), {}};
+
+    // Buses are the only types not added from a generator file.
+    std::map<audio_pipeline::generator_type_handle, std::string> type_ids {};
+    for (auto const& id_to_impl : payload.generator_type_id_to_impl) {
+        type_ids[id_to_impl.second] = id_to_impl.first;
+    }
+    std::set<audio_pipeline::buffer_handle> written_buffers {};
+    for (auto const& step : optimised.steps) {
+        auto type_iter {type_ids.find(step.type)};
+        optimised.step_types.push_back(type_iter != type_ids.end() ? type_iter->second : "bus");
+        written_buffers.insert(std::begin(step.outputs), std::end(step.outputs));
+    }
+
+    for (auto buffer : find_live_buffers(payload)) {
+        auto value {pipeline.get_buffer(buffer)[0]};
+        if (written_buffers.find(buffer) == written_buffers.end() && value != 0.0f) {
+            optimised.constant_buffers.push_back({buffer, value});
+        }
+    }
+    return optimised;
+}
+
+// Adds the buffers, types and steps of payload to pipeline and optimises it, reporting what the
+// optimisation did. Steps optimised for the same audio config when the pipeline was compiled are
+// added as they are.
+void build_pipeline(audio_pipeline& pipeline, pipeline_config_payload& payload) {
+    auto buffer_handles {pipeline.add_buffers(payload.buffer_id_to_handle.size())};
+    auto buffer_handle_iter {std::begin(buffer_handles)};
+    for (auto& id_to_handle : payload.buffer_id_to_handle) {
+        id_to_handle.second = *buffer_handle_iter++;
+        if (payload.feedback_buffer_ids.find(id_to_handle.first) != payload.feedback_buffer_ids.end()) {
+            pipeline.set_buffer_feedback(id_to_handle.second, true);
+        }
+    }
+
+    // Generators were compiled before, adding them only hands the code over.
+    for (auto const& generator_type : payload.generator_section) {
+        auto handle {pipeline.add_generator_type(*generator_type.compiled)};
+        if (pipeline.generator_type_is_valid(handle)) {
+            payload.generator_type_id_to_impl[generator_type.id] = handle;
+        }
+    }
+
+    std::map<std::string, audio_pipeline::voice_pool_handle> voice_pools;
+    voice_buffer_map voice_buffers;
+    add_voice_pools(pipeline, payload, payload.buffer_id_to_handle, voice_pools, voice_buffers);
+
+    auto const& config {pipeline.get_audio_config()};
+    auto const& optimised {payload.optimised};
+    if (optimised && optimised->config.buffer_size == config.buffer_size && optimised->config.sample_rate == config.sample_rate) {
+        add_optimised_steps(pipeline, payload);
+        report_output_latencies(pipeline, payload);
+        return;
+    }
+
+    // All steps are added in one batch, step_numbers holds the pipeline step of every description.
+    std::vector<audio_pipeline::step_description> descriptions {};
+    std::vector<unsigned int> step_numbers {};
+    descriptions.reserve(payload.pipeline_section.size());
+    step_numbers.reserve(payload.pipeline_section.size());
+
+    unsigned int step_number {0};
+    for (auto const& step : payload.pipeline_section) {
+        ++step_number;
+        auto generator_type {find_step_type(pipeline, step, payload.generator_type_id_to_impl, step.generator_type)};
+        if (!pipeline.generator_type_is_valid(generator_type)) {
+            continue;
+        }
+
+        auto voice_count {step.voice_pool.empty() ? 1u : static_cast<unsigned int>(voice_buffers[step.voice_pool].size())};
+        for (unsigned int voice {0}; voice < voice_count; ++voice) {
+            descriptions.push_back(describe_step(step, generator_type, voice, payload.buffer_id_to_handle, voice_pools, voice_buffers));
+            step_numbers.push_back(step_number);
+        }
+    }
+
+    auto generators {pipeline.add_generators_back(descriptions)};
+    if (generators.size() != descriptions.size()) {
+        payload.msg_box->push_error("The pipeline steps could not be added to the audio pipeline");
+    }
+    for (unsigned int i {0}; i < generators.size(); ++i) {
+        payload.generator_step_numbers[generators[i]] = step_numbers[i];
+    }
+
+    // A loop runs from the first generator created for its steps to the last one, voice copies included.
+    std::map<std::string, std::tuple<audio_pipeline::generator_handle, audio_pipeline::generator_handle>> loops;
+    for (unsigned int i {0}; i < generators.size(); ++i) {
+        auto const& loop {payload.pipeline_section[step_numbers[i] - 1].loop};
+        if (loop.empty() || !pipeline.generator_type_is_valid(std::get<0>(generators[i]))) {
+            continue;
+        }
+        auto loop_iter {loops.find(loop)};
+        if (loop_iter == loops.end()) {
+            loops[loop] = {generators[i], generators[i]};
+        } else {
+            std::get<1>(loop_iter->second) = generators[i];
+        }
+    }
+    for (auto const& loop : loops) {
+        pipeline.add_feedback_loop(std::get<0>(loop.second), std::get<1>(loop.second));
+    }
+
+    // Voice steps are reported once for all voices.
+    auto report {pipeline.optimize(find_live_buffers(payload))};
+    std::set<unsigned int> removed_step_numbers {};
+    std::set<unsigned int> folded_step_numbers {};
+    std::set<unsigned int> merged_step_numbers {};
+    std::set<unsigned int> in_place_step_numbers {};
+    for (auto const& generator : report.removed_steps) {
+        removed_step_numbers.insert(payload.generator_step_numbers[generator]);
+    }
+    for (auto const& generator : report.folded_steps) {
+        folded_step_numbers.insert(payload.generator_step_numbers[generator]);
+    }
+    for (auto const& generator : report.merged_steps) {
+        merged_step_numbers.insert(payload.generator_step_numbers[generator]);
+    }
+    for (auto const& generator : report.in_place_steps) {
+        in_place_step_numbers.insert(payload.generator_step_numbers[generator]);
+    }
+    for (auto number : removed_step_numbers) {
+        payload.msg_box->push_info("At pipeline step " + std::to_string(number) + ": Removed, none of its outputs reach an output channel");
+    }
+    for (auto number : folded_step_numbers) {
+        payload.msg_box->push_info("At pipeline step " + std::to_string(number) + ": Folded into constant outputs, all of its inputs are constants");
+    }
+    for (auto number : merged_step_numbers) {
+        payload.msg_box->push_info("At pipeline step " + std::to_string(number) + ": Merged into an earlier step computing the same outputs");
+    }
+    for (auto number : in_place_step_numbers) {
+        payload.msg_box->push_info("At pipeline step " + std::to_string(number) + ": Writes its outputs over input buffers nothing after it uses");
+    }
+    report_output_latencies(pipeline, payload);
+}
+
+std::unique_ptr<audio_process> configure_audio_process(std::unique_ptr<audio_process> aprocess, pipeline_config_payload* payload) {
+    if (!payload->input_section.empty() && !aprocess->start_input()) {
+        payload->msg_box->push_info("The audio input could not be opened, the input channels stay silent");
+    }
+
+    // =====================================================================
+    // ======================== Transform pipeline =========================
+    // =====================================================================
+    // The pipeline is built and optimised on this thread, the audio thread only swaps it in.
+    payload->pipeline = std::make_unique<audio_pipeline>(aprocess->get_audio_config());
+    build_pipeline(*payload->pipeline, *payload);
+
+    aprocess->configure(static_cast<void*>(payload), [](audio_process::configurer& process_configurer, void* p){
+        auto payload {static_cast<pipeline_config_payload*>(p)};
+        process_configurer.swap_pipeline(*payload->pipeline);
+
+        for (auto const& step: payload->output_section) {
+            if (payload->buffer_id_to_handle.find(step.buffer_id) == payload->buffer_id_to_handle.end()) {
+                continue;
+            }
+
+            if (step.channel_name == "left") {
+                process_configurer.set_left_channel_buffer(payload->buffer_id_to_handle[step.buffer_id]);
+            } else if (step.channel_name == "right") {
+                process_configurer.set_right_channel_buffer(payload->buffer_id_to_handle[step.buffer_id]);
+            }
+        }
+
+        for (auto const& step: payload->input_section) {
+            if (step.channel_name == "left") {
+                process_configurer.set_left_input_channel_buffer(payload->buffer_id_to_handle[step.buffer_id]);
+            } else if (step.channel_name == "right") {
+                process_configurer.set_right_input_channel_buffer(payload->buffer_id_to_handle[step.buffer_id]);
+            }
+        }
+    }, [](void *p){
+        auto payload {static_cast<pipeline_config_payload*>(p)};
+        delete payload;
+    });
+
+    return aprocess;
+}
+
+bool is_identifier_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Reads the id of a generator from its code without compiling it, from an id function made of a
+// single return of a string literal. Gives an empty string for an id returned any other way.
+std::string scan_generator_id(std::string const& code) {
+    auto skip_spaces {[&code](std::string::size_type position) {
+        while (position < code.size() && std::isspace(static_cast<unsigned char>(code[position]))) {
+            ++position;
+        }
+        return position;
+    }};
+
+    auto skip_token {[&code, &skip_spaces](std::string::size_type position, char const* token) {
+        auto length {std::strlen(token)};
+        return code.compare(position, length, token) == 0 ? skip_spaces(position + length) : position;
+    }};
+
+    for (auto position {code.find("id")}; position != std::string::npos; position = code.find("id", position + 2)) {
+        if (position > 0 && is_identifier_char(code[position - 1])) {
+            continue;
+        }
+        // Only a definition taking no arguments counts, id(void) { or id() {.
+        auto parameters_start {skip_spaces(position + 2)};
+        if (code.compare(parameters_start, 1, "(") != 0) {
+            continue;
+        }
+        auto parameters_end {skip_token(skip_spaces(parameters_start + 1), "void")};
+        if (code.compare(parameters_end, 1, ")") != 0) {
+            continue;
+        }
+        auto body_start {skip_spaces(parameters_end + 1)};
+        if (code.compare(body_start, 1, "{") != 0) {
+            continue;
+        }
+        auto return_start {skip_spaces(body_start + 1)};
+        if (code.compare(return_start, 6, "return") != 0) {
+            continue;
+        }
+        auto literal_start {skip_spaces(return_start + 6)};
+        if (code.compare(literal_start, 1, "\"") != 0) {
+            continue;
+        }
+        auto literal_end {code.find_first_of("\"\\\n", literal_start + 1)};
+        if (literal_end == std::string::npos || code[literal_end] != '"') {
+            return "";
+        }
+        return code.substr(literal_start + 1, literal_end - literal_start - 1);
+    }
+    return "";
+}
+
+// Compiles the generators used by a pipeline step, away from the audio thread, and drops the rest.
+// Generators whose id can not be read from their code are compiled to learn it.
+void compile_generators(pipeline_config_payload& payload) {
+    std::set<std::string> used_ids {};
+    for (auto const& step : payload.pipeline_section) {
+        used_ids.insert(step.generator_type);
+    }
+
+    std::vector<generator_section_step> candidates {};
+    std::vector<std::string> generator_codes {};
+    for (auto& generator_type : payload.generator_section) {
+        auto id {scan_generator_id(generator_type.generator_code)};
+        if (!id.empty() && used_ids.find(id) == used_ids.end()) {
+            continue;
+        }
+        generator_codes.push_back(generator_type.generator_code);
+        candidates.push_back(std::move(generator_type));
+    }
+    auto compiled {audio_pipeline::compile_generator_types(generator_codes)};
+
+    std::vector<generator_section_step> used_generators {};
+    for (unsigned int i {0}; i < candidates.size(); ++i) {
+        if (!compiled[i]) {
+            continue;
+        }
+        auto id {audio_pipeline::get_compiled_generator_id(*compiled[i])};
+        if (used_ids.find(id) == used_ids.end()) {
+            continue;
+        }
+        auto& generator_type {candidates[i]};
+        generator_type.compiled = std::move(compiled[i]);
+        generator_type.id = std::move(id);
+        used_generators.push_back(std::move(generator_type));
+    }
+    payload.generator_section = std::move(used_generators);
+}
+
+// Links the objects of a compiled pipeline instead of compiling the generators. Returns false if
+// any of them fails to link.
+bool link_compiled_generators(pipeline_config_payload& payload) {
+    std::vector<std::string> object_paths {};
+    for (auto const& generator_type : payload.generator_section) {
+        object_paths.push_back(generator_type.object_path);
+    }
+    auto compiled {audio_pipeline::load_generator_objects(object_paths)};
+    for (unsigned int i {0}; i < compiled.size(); ++i) {
+        if (!compiled[i]) {
+            return false;
+        }
+        auto& generator_type {payload.generator_section[i]};
+        generator_type.id = audio_pipeline::get_compiled_generator_id(*compiled[i]);
+        generator_type.compiled = std::move(compiled[i]);
+    }
+    return true;
+}
+
+// Constant inputs changed by a reload glide to their new value over this many seconds.
+const float RELOAD_RAMP_TIME {0.02f};
+
+// A step of a pipeline loaded by a pipeline_reloader, with the generators created for it, one per
+// voice of its pool. Type keys tell apart the versions of a generator type, see get_type_key.
+struct running_step {
+    pipeline_section_step step;
+    std::string type_key;
+    std::vector<audio_pipeline::generator_handle> generators;
+};
+
+// Everything a pipeline_reloader put into the audio pipeline. Only its configure callbacks use it, in
+// the order they were queued in, so it always matches the pipeline they change.
+struct running_pipeline {
+    std::vector<running_step> steps;
+    std::map<std::string, audio_pipeline::generator_type_handle> types;
+    std::map<unsigned int, audio_pipeline::buffer_handle> buffer_id_to_handle;
+    std::set<unsigned int> feedback_buffer_ids;
+    std::vector<output_section_step> output_section;
+    std::map<std::string, audio_pipeline::voice_pool_handle> voice_pools;
+    voice_buffer_map voice_buffers;
+
+    // First generator of every feedback loop.
+    std::vector<audio_pipeline::generator_handle> loop_starts;
+};
+
+// A generator file as a pipeline_reloader last read it.
+struct loaded_generator {
+    unsigned long long code_hash;
+
+    // Empty when the code did not compile.
+    std::string id;
+
+    // Compiled code not handed to the pipeline yet, types are only added once a step uses them.
+    std::shared_ptr<audio_pipeline::compiled_generator_type> compiled;
+};
+
+// A config loaded again, and which running step each of its steps keeps.
+struct pipeline_reload_payload {
+    std::unique_ptr<pipeline_config_payload> config;
+    std::shared_ptr<running_pipeline> running;
+    bool first_load;
+
+    // Type key of every step, and the running step kept for it, UINT_MAX for steps added anew.
+    std::vector<std::string> step_type_keys;
+    std::vector<unsigned int> kept_steps;
+
+    // Types the steps need that are not in the pipeline yet, by type key.
+    std::vector<std::tuple<std::string, std::shared_ptr<audio_pipeline::compiled_generator_type>>> new_types;
+};
+
+// Generator ids stay the same when their code is edited, so types are told apart by id and code.
+std::string get_type_key(std::string const& id, unsigned long long code_hash) {
+    return id + "@" + std::to_string(code_hash);
+}
+
+bool parameters_equal(pipeline_step_input_parameter const& a, pipeline_step_input_parameter const& b) {
+    if (a.is_trigger != b.is_trigger || a.is_buffer != b.is_buffer) {
+        return false;
+    }
+    if (a.is_trigger) {
+        return a.trigger == b.trigger;
+    }
+    return a.is_buffer ? a.buffer_id == b.buffer_id : a.value == b.value;
+}
+
+bool steps_equal(pipeline_section_step const& a, pipeline_section_step const& b) {
+    if (a.generator_type != b.generator_type || a.voice_pool != b.voice_pool || a.loop != b.loop) {
+        return false;
+    }
+    if (a.control_rate != b.control_rate || a.control_interpolation != b.control_interpolation || a.oversampling != b.oversampling) {
+        return false;
+    }
+    if (a.input_parameters.size() != b.input_parameters.size() || a.output_parameters.size() != b.output_parameters.size()) {
+        return false;
+    }
+    for (unsigned int i {0}; i < a.input_parameters.size(); ++i) {
+        if (!parameters_equal(a.input_parameters[i], b.input_parameters[i])) {
+            return false;
+        }
+    }
+    for (unsigned int i {0}; i < a.output_parameters.size(); ++i) {
+        if (a.output_parameters[i].buffer_id != b.output_parameters[i].buffer_id) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool voice_sections_equal(std::vector<voice_section_step> const& a, std::vector<voice_section_step> const& b) {
+    return std::equal(std::begin(a), std::end(a), std::begin(b), std::end(b), [](voice_section_step const& x, voice_section_step const& y) {
+        return x.name == y.name && x.voice_count == y.voice_count && x.policy == y.policy && x.output_buffer_id == y.output_buffer_id &&
+            x.mix_buffer_id == y.mix_buffer_id && x.private_buffer_ids == y.private_buffer_ids;
+    });
+}
+
+// Running step every new step keeps, UINT_MAX for the ones added anew. A step first keeps a running
+// step identical to it, then one of the same type and port counts it gets rebound from. Steps of
+// voice pools are only kept when identical.
+std::vector<unsigned int> match_running_steps(std::vector<pipeline_section_step> const& running_steps, std::vector<std::string> const& running_type_keys,
+                                              std::vector<pipeline_section_step> const& steps, std::vector<std::string> const& type_keys) {
+    std::vector<unsigned int> kept_steps(steps.size(), UINT_MAX);
+    std::vector<bool> running_taken(running_steps.size(), false);
+    for (unsigned int i {0}; i < steps.size(); ++i) {
+        for (unsigned int k {0}; k < running_steps.size(); ++k) {
+            if (!running_taken[k] && running_type_keys[k] == type_keys[i] && steps_equal(running_steps[k], steps[i])) {
+                kept_steps[i] = k;
+                running_taken[k] = true;
+                break;
+            }
+        }
+    }
+    for (unsigned int i {0}; i < steps.size(); ++i) {
+        if (kept_steps[i] != UINT_MAX || !steps[i].voice_pool.empty()) {
+            continue;
+        }
+        for (unsigned int k {0}; k < running_steps.size(); ++k) {
+            auto const& running_step {running_steps[k]};
+            if (running_taken[k] || running_type_keys[k] != type_keys[i] || !running_step.voice_pool.empty()) {
+                continue;
+            }
+            if (running_step.input_parameters.size() == steps[i].input_parameters.size() && running_step.output_parameters.size() == steps[i].output_parameters.size()) {
+                kept_steps[i] = k;
+                running_taken[k] = true;
+                break;
+            }
+        }
+    }
+    return kept_steps;
+}
+
+// Whether rebinding running_step to step changes how the signal flows, not just constants.
+bool rebinding_changes_signal_path(pipeline_section_step const& running_step, pipeline_section_step const& step) {
+    for (unsigned int i {0}; i < step.input_parameters.size(); ++i) {
+        auto const& from {running_step.input_parameters[i]};
+        auto const& to {step.input_parameters[i]};
+        if (!parameters_equal(from, to) && (from.is_buffer || to.is_buffer)) {
+            return true;
+        }
+    }
+    for (unsigned int i {0}; i < step.output_parameters.size(); ++i) {
+        if (running_step.output_parameters[i].buffer_id != step.output_parameters[i].buffer_id) {
+            return true;
+        }
+    }
+    return running_step.control_rate != step.control_rate || running_step.control_interpolation != step.control_interpolation ||
+        running_step.oversampling != step.oversampling || running_step.loop != step.loop;
+}
+
+// Whether applying reload changes how the signal flows, worked out before anything changes so the
+// running pipeline can still be rendered to crossfade from.
+bool reload_changes_signal_path(pipeline_reload_payload const& reload) {
+    auto const& config {*reload.config};
+    auto const& running {*reload.running};
+    if (config.feedback_buffer_ids != running.feedback_buffer_ids) {
+        return true;
+    }
+    auto outputs_changed {!std::equal(std::begin(running.output_section), std::end(running.output_section), std::begin(config.output_section), std::end(config.output_section),
+        [](output_section_step const& a, output_section_step const& b) {
+            return a.channel_name == b.channel_name && a.buffer_id == b.buffer_id;
+        })};
+    if (outputs_changed) {
+        return true;
+    }
+
+    std::vector<bool> running_kept(running.steps.size(), false);
+    for (unsigned int i {0}; i < reload.kept_steps.size(); ++i) {
+        auto kept_step {reload.kept_steps[i]};
+        if (kept_step == UINT_MAX || rebinding_changes_signal_path(running.steps[kept_step].step, config.pipeline_section[i])) {
+            return true;
+        }
+        running_kept[kept_step] = true;
+    }
+    return std::find(std::begin(running_kept), std::end(running_kept), false) != std::end(running_kept);
+}
+
+// Binds the generator of a kept step the way step asks for, keeping its state. Returns whether
+// anything changed.
+bool rebind_step(audio_pipeline& pipeline, pipeline_section_step const& running_step, pipeline_section_step const& step, audio_pipeline::generator_handle generator,
+                 std::map<unsigned int, audio_pipeline::buffer_handle>& buffer_id_to_handle) {
+    auto rebound {false};
+    for (unsigned int i {0}; i < step.input_parameters.size(); ++i) {
+        auto const& from {running_step.input_parameters[i]};
+        auto const& to {step.input_parameters[i]};
+        if (parameters_equal(from, to)) {
+            continue;
+        }
+        rebound = true;
+        if (to.is_buffer) {
+            pipeline.set_generator_input_buffer(generator, i, buffer_id_to_handle[to.buffer_id]);
+        } else if (from.is_buffer) {
+            pipeline.set_generator_input_value(generator, i, to.value);
+        } else {
+            pipeline.set_generator_input_ramp(generator, i, to.value, RELOAD_RAMP_TIME, audio_pipeline::ramp_shape::linear);
+        }
+    }
+    for (unsigned int i {0}; i < step.output_parameters.size(); ++i) {
+        if (running_step.output_parameters[i].buffer_id != step.output_parameters[i].buffer_id) {
+            pipeline.set_generator_output_buffer(generator, i, buffer_id_to_handle[step.output_parameters[i].buffer_id]);
+            rebound = true;
+        }
+    }
+
+    if (running_step.control_rate != step.control_rate || running_step.control_interpolation != step.control_interpolation) {
+        if (step.control_rate) {
+            pipeline.set_generator_control_rate(generator, step.control_interpolation);
+        } else {
+            pipeline.set_generator_audio_rate(generator);
+        }
+        rebound = true;
+    }
+    if (running_step.oversampling != step.oversampling) {
+        pipeline.set_generator_oversampling(generator, step.oversampling);
+        rebound = true;
+    }
+    if (running_step.loop != step.loop) {
+        rebound = true;
+    }
+    return rebound;
+}
+
+void apply_pipeline_reload(audio_process::configurer& process_configurer, void* p) {
+    auto reload {static_cast<pipeline_reload_payload*>(p)};
+    auto& config {*reload->config};
+    auto& running {*reload->running};
+    auto& pipeline {process_configurer.get_pipeline()};
+    if (!reload->first_load && reload_changes_signal_path(*reload)) {
+        process_configurer.declick();
+    }
+
+    for (auto& new_type : reload->new_types) {
+        auto handle {pipeline.add_generator_type(*std::get<1>(new_type))};
+        if (pipeline.generator_type_is_valid(handle)) {
+            running.types[std::get<0>(new_type)] = handle;
+        }
+    }
+
+    // Buffers kept by the new config keep their contents, buffers it no longer has go once no step uses them.
+    for (auto const& id_to_handle : config.buffer_id_to_handle) {
+        if (running.buffer_id_to_handle.find(id_to_handle.first) == running.buffer_id_to_handle.end()) {
+            running.buffer_id_to_handle[id_to_handle.first] = pipeline.add_buffer();
+        }
+    }
+    for (auto const& id_to_handle : running.buffer_id_to_handle) {
+        auto feedback {config.feedback_buffer_ids.find(id_to_handle.first) != config.feedback_buffer_ids.end()};
+        if (feedback != (running.feedback_buffer_ids.find(id_to_handle.first) != running.feedback_buffer_ids.end())) {
+            pipeline.set_buffer_feedback(id_to_handle.second, feedback);
+        }
+    }
+    running.feedback_buffer_ids = config.feedback_buffer_ids;
+
+    if (reload->first_load) {
+        add_voice_pools(pipeline, config, running.buffer_id_to_handle, running.voice_pools, running.voice_buffers);
+    }
+
+    // Loops are added again once all steps are in their new order.
+    for (auto const& loop_start : running.loop_starts) {
+        pipeline.delete_feedback_loop(loop_start);
+    }
+    running.loop_starts.clear();
+
+    std::vector<bool> running_kept(running.steps.size(), false);
+    for (auto kept_step : reload->kept_steps) {
+        if (kept_step != UINT_MAX) {
+            running_kept[kept_step] = true;
+        }
+    }
+    unsigned int removed_count {0};
+    for (unsigned int i {0}; i < running.steps.size(); ++i) {
+        if (running_kept[i]) {
+            continue;
+        }
+        for (auto const& generator : running.steps[i].generators) {
+            if (pipeline.generator_type_is_valid(std::get<0>(generator))) {
+                pipeline.delete_generator(generator);
+            }
+        }
+        ++removed_count;
+    }
+
+    // Steps added anew are added in one batch, description_steps holds the step of every description.
+    std::vector<running_step> steps(config.pipeline_section.size());
+    std::vector<audio_pipeline::step_description> descriptions {};
+    std::vector<unsigned int> description_steps {};
+    unsigned int kept_count {0};
+    unsigned int rebound_count {0};
+    unsigned int added_count {0};
+    for (unsigned int i {0}; i < steps.size(); ++i) {
+        auto const& step {config.pipeline_section[i]};
+        steps[i].step = step;
+        steps[i].type_key = reload->step_type_keys[i];
+
+        auto kept_step {reload->kept_steps[i]};
+        if (kept_step != UINT_MAX) {
+            auto& running_step {running.steps[kept_step]};
+            steps[i].generators = std::move(running_step.generators);
+            auto const& generators {steps[i].generators};
+            auto generator_valid {generators.size() == 1 && pipeline.generator_type_is_valid(std::get<0>(generators[0]))};
+            if (generator_valid && rebind_step(pipeline, running_step.step, step, generators[0], running.buffer_id_to_handle)) {
+                ++rebound_count;
+            } else {
+                ++kept_count;
+            }
+            continue;
+        }
+
+        auto generator_type {find_step_type(pipeline, step, running.types, steps[i].type_key)};
+        if (!pipeline.generator_type_is_valid(generator_type)) {
+            continue;
+        }
+        auto voice_count {step.voice_pool.empty() ? 1u : static_cast<unsigned int>(running.voice_buffers[step.voice_pool].size())};
+        for (unsigned int voice {0}; voice < voice_count; ++voice) {
+            descriptions.push_back(describe_step(step, generator_type, voice, running.buffer_id_to_handle, running.voice_pools, running.voice_buffers));
+            description_steps.push_back(i);
+        }
+        ++added_count;
+    }
+
+    auto generators {pipeline.add_generators_back(descriptions)};
+    if (generators.size() != descriptions.size()) {
+        config.msg_box->push_error("The pipeline steps could not be added to the audio pipeline");
+    }
+    for (unsigned int i {0}; i < generators.size(); ++i) {
+        steps[description_steps[i]].generators.push_back(generators[i]);
+    }
+
+    // The steps of the new config are in its order already, their generators are put in it in one go.
+    std::vector<audio_pipeline::generator_handle> order {};
+    order.reserve(generators.size() + steps.size());
+    std::map<std::string, std::tuple<audio_pipeline::generator_handle, audio_pipeline::generator_handle>> loops;
+    for (auto const& step : steps) {
+        for (auto const& generator : step.generators) {
+            if (!pipeline.generator_type_is_valid(std::get<0>(generator))) {
+                continue;
+            }
+            order.push_back(generator);
+            if (step.step.loop.empty()) {
+                continue;
+            }
+            auto loop_iter {loops.find(step.step.loop)};
+            if (loop_iter == loops.end()) {
+                loops[step.step.loop] = {generator, generator};
+            } else {
+                std::get<1>(loop_iter->second) = generator;
+            }
+        }
+    }
+    pipeline.reorder_generators(order);
+    for (auto const& loop : loops) {
+        pipeline.add_feedback_loop(std::get<0>(loop.second), std::get<1>(loop.second));
+        running.loop_starts.push_back(std::get<0>(loop.second));
+    }
+    running.steps = std::move(steps);
+
+    // Types no step refers to anymore go, the reloader compiles them again should a step need them.
+    std::set<std::string> used_type_keys {std::begin(reload->step_type_keys), std::end(reload->step_type_keys)};
+    for (auto iter {std::begin(running.types)}; iter != std::end(running.types);) {
+        if (used_type_keys.find(iter->first) == used_type_keys.end()) {
+            pipeline.delete_generator_type(iter->second);
+            iter = running.types.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+
+    for (auto iter {std::begin(running.buffer_id_to_handle)}; iter != std::end(running.buffer_id_to_handle);) {
+        if (config.buffer_id_to_handle.find(iter->first) == config.buffer_id_to_handle.end()) {
+            pipeline.delete_buffer(iter->second);
+            iter = running.buffer_id_to_handle.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+
+    running.output_section = config.output_section;
+    for (auto const& step : config.output_section) {
+        auto handle_iter {running.buffer_id_to_handle.find(step.buffer_id)};
+        if (handle_iter == running.buffer_id_to_handle.end()) {
+            continue;
+        }
+        if (step.channel_name == "left") {
+            process_configurer.set_left_channel_buffer(handle_iter->second);
+        } else if (step.channel_name == "right") {
+            process_configurer.set_right_channel_buffer(handle_iter->second);
+        }
+    }
+    for (auto const& step : config.input_section) {
+        if (step.channel_name == "left") {
+            process_configurer.set_left_input_channel_buffer(running.buffer_id_to_handle[step.buffer_id]);
+        } else if (step.channel_name == "right") {
+            process_configurer.set_right_input_channel_buffer(running.buffer_id_to_handle[step.buffer_id]);
+        }
+    }
+
+    if (reload->first_load) {
+        return;
+    }
+    config.msg_box->push_info("Reloaded the pipeline: " + std::to_string(kept_count) + " steps kept, " + std::to_string(rebound_count) + " rebound, " +
+        std::to_string(added_count) + " added, " + std::to_string(removed_count) + " removed");
+}
+
+}
+
+std::unique_ptr<audio_process> load_pipeline_from_file(std::unique_ptr<audio_process> aprocess, std::string const& path, message_box& msg_box) {
+    auto payload {read_compiled_pipeline(path)};
+    if (payload && !link_compiled_generators(*payload)) {
+        delete payload;
+        payload = nullptr;
+    }
+    if (!payload) {
+        payload = parse_pipeline_config(path, msg_box);
+        if (!payload) {
+            return aprocess;
+        }
+        compile_generators(*payload);
+    }
+    payload->msg_box = &msg_box;
+    return configure_audio_process(std::move(aprocess), payload);
+}
+
+bool compile_pipeline_file(std::string const& path, message_box& msg_box) {
+    auto payload {std::unique_ptr<pipeline_config_payload> {parse_pipeline_config(path, msg_box)}};
+    if (!payload) {
+        return false;
+    }
+    payload->msg_box = &msg_box;
+
+    // Only the generators the steps use end up in the compiled pipeline, each in an object file of its own.
+    compile_generators(*payload);
+    for (unsigned int i {0}; i < payload->generator_section.size(); ++i) {
+        auto& generator_type {payload->generator_section[i]};
+        generator_type.object_path = get_compiled_object_path(path, i);
+        if (!audio_pipeline::write_generator_object(generator_type.generator_code, generator_type.object_path)) {
+            msg_box.push_error("Generator file " + generator_type.path + " could not be compiled to " + generator_type.object_path);
+            return false;
+        }
+    }
+
+    // Loads with another audio config optimise the steps again.
+    audio_pipeline pipeline {DEFAULT_AUDIO_CONFIG};
+    build_pipeline(pipeline, *payload);
+    auto optimised {describe_optimised_pipeline(pipeline, *payload)};
+
+    mapped_file config_file {path};
+    auto bytes {write_compiled_pipeline(*payload, optimised, hash_contents(config_file.contents()))};
+
+    // Written next to the final file first, so a pipeline loading meanwhile never sees half of it.
+    auto compiled_path {get_compiled_pipeline_path(path)};
+    auto temporary_path {compiled_path + ".tmp"};
+    {
+        std::ofstream file {temporary_path, std::ios::binary | std::ios::trunc};
+        file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if (file.fail()) {
+            msg_box.push_error("Compiled pipeline " + compiled_path + " could not be written");
+            return false;
+        }
+    }
+    if (std::rename(temporary_path.c_str(), compiled_path.c_str()) != 0) {
+        std::remove(temporary_path.c_str());
+        msg_box.push_error("Compiled pipeline " + compiled_path + " could not be written");
+        return false;
+    }
+
+    msg_box.push_info("Compiled pipeline written to " + compiled_path);
+    return true;
+}
+
+struct pipeline_reloader::impl {
+    std::string path;
+    file_watcher watcher;
+    std::shared_ptr<running_pipeline> running {std::make_shared<running_pipeline>()};
+    bool loaded {false};
+
+    // Steps and voice pools of the config last handed to the audio process.
+    std::vector<pipeline_section_step> steps;
+    std::vector<std::string> step_type_keys;
+    std::vector<voice_section_step> voice_section;
+
+    // Every generator file read so far, by path.
+    std::map<std::string, loaded_generator> generators;
+
+    void reload(audio_process& aprocess, message_box& msg_box) {
+        auto config {std::unique_ptr<pipeline_config_payload> {parse_pipeline_config(path, msg_box)}};
+        if (!config) {
+            return;
+        }
+        config->msg_box = &msg_box;
+
+        std::vector<std::string> watched_paths {path};
+        for (auto const& generator : config->generator_section) {
+            watched_paths.push_back(generator.path);
+        }
+        watcher.watch(watched_paths);
+
+        // Only generators read for the first time or edited since are compiled.
+        std::vector<std::string> changed_paths {};
+        std::vector<std::string> changed_codes {};
+        std::vector<unsigned long long> changed_hashes {};
+        for (auto const& generator : config->generator_section) {
+            auto code_hash {hash_contents(generator.generator_code)};
+            auto loaded_iter {generators.find(generator.path)};
+            if (loaded_iter == generators.end() || loaded_iter->second.code_hash != code_hash) {
+                changed_paths.push_back(generator.path);
+                changed_codes.push_back(generator.generator_code);
+                changed_hashes.push_back(code_hash);
+            }
+        }
+
+        // A generator that no longer compiles keeps running in its last version, so steps using it stay.
+        auto compiled {audio_pipeline::compile_generator_types(changed_codes)};
+        for (unsigned int i {0}; i < changed_paths.size(); ++i) {
+            if (!compiled[i]) {
+                msg_box.push_error("Generator file " + changed_paths[i] + " could not be compiled, its previous version is kept");
+                continue;
+            }
+            generators[changed_paths[i]] = {changed_hashes[i], audio_pipeline::get_compiled_generator_id(*compiled[i]), std::move(compiled[i])};
+        }
+
+        // Later generators of the same id win, as they do when loading a pipeline.
+        std::map<std::string, loaded_generator*> generators_by_id {};
+        for (auto const& generator : config->generator_section) {
+            auto& loaded {generators[generator.path]};
+            if (!loaded.id.empty()) {
+                generators_by_id[loaded.id] = &loaded;
+            }
+        }
+
+        auto reload_payload {std::make_unique<pipeline_reload_payload>()};
+        for (auto const& step : config->pipeline_section) {
+            auto generator_iter {generators_by_id.find(step.generator_type)};
+            if (step.generator_type == "bus") {
+                reload_payload->step_type_keys.push_back("bus");
+            } else if (generator_iter != generators_by_id.end()) {
+                reload_payload->step_type_keys.push_back(get_type_key(generator_iter->second->id, generator_iter->second->code_hash));
+            } else {
+                reload_payload->step_type_keys.push_back({});
+            }
+        }
+        auto kept_steps {match_running_steps(steps, step_type_keys, config->pipeline_section, reload_payload->step_type_keys)};
+
+        // Voice pools are made along with the pipeline, their steps are only ever kept as they are.
+        if (loaded) {
+            auto voices_changed {!voice_sections_equal(voice_section, config->voice_section)};
+            std::vector<bool> running_kept(steps.size(), false);
+            for (unsigned int i {0}; i < kept_steps.size(); ++i) {
+                if (kept_steps[i] != UINT_MAX) {
+                    running_kept[kept_steps[i]] = true;
+                } else if (!config->pipeline_section[i].voice_pool.empty()) {
+                    voices_changed = true;
+                }
+            }
+            for (unsigned int i {0}; i < steps.size(); ++i) {
+                if (!running_kept[i] && !steps[i].voice_pool.empty()) {
+                    voices_changed = true;
+                }
+            }
+            if (voices_changed) {
+                msg_box.push_error("Voice pools and their steps can not be changed while running, restart to apply the edits");
+                return;
+            }
+        }
+
+        // Types are handed to the pipeline when a step first uses them.
+        for (auto const& step : config->pipeline_section) {
+            auto generator_iter {generators_by_id.find(step.generator_type)};
+            if (step.generator_type == "bus" || generator_iter == generators_by_id.end() || !generator_iter->second->compiled) {
+                continue;
+            }
+            auto& loaded {*generator_iter->second};
+            reload_payload->new_types.push_back({get_type_key(loaded.id, loaded.code_hash), std::move(loaded.compiled)});
+            loaded.compiled = nullptr;
+        }
+
+        // The pipeline releases the types no step uses, their code is read and compiled again when needed.
+        std::set<std::string> used_type_keys {std::begin(reload_payload->step_type_keys), std::end(reload_payload->step_type_keys)};
+        for (auto iter {std::begin(generators)}; iter != std::end(generators);) {
+            auto const& loaded {iter->second};
+            if (!loaded.id.empty() && !loaded.compiled && used_type_keys.find(get_type_key(loaded.id, loaded.code_hash)) == used_type_keys.end()) {
+                iter = generators.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+
+        steps = config->pipeline_section;
+        step_type_keys = reload_payload->step_type_keys;
+        voice_section = config->voice_section;
+        reload_payload->first_load = !loaded;
+        loaded = true;
+
+        reload_payload->config = std::move(config);
+        reload_payload->running = running;
+        reload_payload->kept_steps = std::move(kept_steps);
+        if (!reload_payload->config->input_section.empty() && !aprocess.start_input()) {
+            msg_box.push_info("The audio input could not be opened, the input channels stay silent");
+        }
+        aprocess.configure(static_cast<void*>(reload_payload.release()), apply_pipeline_reload, [](void* p) {
+            delete static_cast<pipeline_reload_payload*>(p);
+        });
+    }
+};
+
+pipeline_reloader::pipeline_reloader(std::string const& path) : internal{new impl} {
+    internal->path = path;
+}
+
+pipeline_reloader::~pipeline_reloader() {
+    delete internal;
+}
+
+void pipeline_reloader::load(audio_process& aprocess, message_box& msg_box) {
+    // A config with errors is watched all the same, so it loads once they are fixed.
+    internal->watcher.watch({internal->path});
+    internal->reload(aprocess, msg_box);
+}
+
+void pipeline_reloader::reload_changes(audio_process& aprocess, message_box& msg_box) {
+    if (internal->watcher.poll_changes().empty()) {
+        return;
+    }
+    internal->reload(aprocess, msg_box);
 }
 
 }
\ No newline at end of file
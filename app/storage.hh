@@ -7,6 +7,38 @@
 
 namespace bzzt {
 
+// Loads the compiled pipeline next to the config at path when there is one and neither the config
+// nor any generator source changed since it was compiled, the config itself otherwise.
 std::unique_ptr<audio_process> load_pipeline_from_file(std::unique_ptr<audio_process> aprocess, std::string const& path, message_box& msg_box);
 
+// Parses and checks the config at path and writes it compiled to path.compiled, with the object file
+// of every generator it uses and its steps optimised for the default audio config. Later loads skip
+// all parsing, compiling and optimising. Returns false, with the reasons in msg_box, when the config
+// has errors or the compiled pipeline could not be written.
+bool compile_pipeline_file(std::string const& path, message_box& msg_box);
+
+// Keeps the pipeline of a config in step with the edits saved to the config and its generator files.
+// Steps an edit leaves alone keep running with their state, the others are rebound, added or removed
+// in place, and only edited generators are compiled again. Pipelines loaded this way are not
+// optimised, so every step of the config stays where the next edit finds it.
+struct pipeline_reloader {
+    explicit pipeline_reloader(std::string const& path);
+    pipeline_reloader(pipeline_reloader const& other) = delete;
+    pipeline_reloader(pipeline_reloader&& other) = delete;
+    pipeline_reloader& operator=(pipeline_reloader const& other) = delete;
+    pipeline_reloader& operator=(pipeline_reloader&& other) = delete;
+    ~pipeline_reloader();
+
+    // Loads the config into the audio process, which has to hold no pipeline yet.
+    void load(audio_process& aprocess, message_box& msg_box);
+
+    // Applies the edits saved since the last call, without blocking when there are none. A config
+    // with errors leaves the running pipeline as it is.
+    void reload_changes(audio_process& aprocess, message_box& msg_box);
+
+private:
+    struct impl;
+    impl* internal;
+};
+
 }
\ No newline at end of file
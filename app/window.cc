@@ -1,19 +1,23 @@
 #include "window.hh"
 
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <iterator>
+#include <tuple>
 
 namespace bzzt {
 
 namespace {
 
-void key_callback(GLFWwindow* win, int key, int scancode, int action, int mods) {
-    (void)scancode;
-    (void)mods;
-    window* w = static_cast<window*>(glfwGetWindowUserPointer(win));
-    if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
-        w->close();
-    }
-}
+const float LOWEST_KEY_NOTE {48.0f};
+
+// Keys playing notes and their semitone above LOWEST_KEY_NOTE.
+const std::tuple<int, unsigned int> NOTE_KEYS[] {
+    {GLFW_KEY_Z, 0}, {GLFW_KEY_S, 1}, {GLFW_KEY_X, 2}, {GLFW_KEY_D, 3}, {GLFW_KEY_C, 4}, {GLFW_KEY_V, 5},
+    {GLFW_KEY_G, 6}, {GLFW_KEY_B, 7}, {GLFW_KEY_H, 8}, {GLFW_KEY_N, 9}, {GLFW_KEY_J, 10}, {GLFW_KEY_M, 11},
+    {GLFW_KEY_Q, 12}, {GLFW_KEY_2, 13}, {GLFW_KEY_W, 14}, {GLFW_KEY_3, 15}, {GLFW_KEY_E, 16}, {GLFW_KEY_R, 17},
+    {GLFW_KEY_5, 18}, {GLFW_KEY_T, 19}, {GLFW_KEY_6, 20}, {GLFW_KEY_Y, 21}, {GLFW_KEY_7, 22}, {GLFW_KEY_U, 23}
+};
 
 void window_resize_callback(GLFWwindow* win, int width, int height) {
     (void) win;
@@ -29,6 +33,24 @@ struct window::impl {
     bool running;
     unsigned int width;
     unsigned int height;
+    std::vector<note_event> note_events;
+
+    static void key_callback(GLFWwindow* win, int key, int scancode, int action, int mods) {
+        (void)scancode;
+        (void)mods;
+        window* w = static_cast<window*>(glfwGetWindowUserPointer(win));
+        if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
+            w->close();
+        }
+
+        // Held keys repeat, only the first press plays the note.
+        auto note_key {std::find_if(std::begin(NOTE_KEYS), std::end(NOTE_KEYS), [key](std::tuple<int, unsigned int> const& note_key) {
+            return std::get<0>(note_key) == key;
+        })};
+        if (note_key != std::end(NOTE_KEYS) && action != GLFW_REPEAT) {
+            w->internal->note_events.push_back({LOWEST_KEY_NOTE + static_cast<float>(std::get<1>(*note_key)), action == GLFW_PRESS});
+        }
+    }
 };
 
 window::window(unsigned int width, unsigned int height) : internal{new window::impl} {
@@ -47,7 +69,7 @@ window::window(unsigned int width, unsigned int height) : internal{new window::i
     glfwMakeContextCurrent(internal->win);
     glfwSwapInterval(0);
     glfwSetWindowUserPointer(internal->win, static_cast<void*>(this));
-    glfwSetKeyCallback(internal->win, key_callback);
+    glfwSetKeyCallback(internal->win, impl::key_callback);
     glfwSetWindowSizeCallback(internal->win, window_resize_callback);
 }
 
@@ -82,4 +104,10 @@ void window::close() {
     internal->running = false;
 }
 
+std::vector<window::note_event> window::take_note_events() {
+    std::vector<note_event> events {};
+    std::swap(events, internal->note_events);
+    return events;
+}
+
 }
\ No newline at end of file
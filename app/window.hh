@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <exception>
 
 namespace bzzt {
@@ -18,6 +19,12 @@ private:
 };
 
 struct window {
+    // Note number, 60 being middle C, and whether its key went down or up.
+    struct note_event {
+        float note;
+        bool on;
+    };
+
     window(unsigned int width, unsigned int height);
     window(window const& other) = delete;
     window(window&& other) = delete;
@@ -30,6 +37,10 @@ struct window {
     void handle_incoming_events();
     void close();
 
+    // Notes played on the keyboard since the last call. Z to M play an octave from note 48 and Q to U
+    // the one above, with the keys of the row over each playing the sharps like on a piano.
+    std::vector<note_event> take_note_events();
+
 private:
     struct impl;
     impl* internal;
@@ -0,0 +1,171 @@
+#include "parsers.hh"
+#include <regex>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <cstdlib>
+#include <pthread.h>
+
+// Tokenizes a generated config of many pipeline steps with the lexer in parsers.cc and with the
+// regex parser it replaced, kept below as it was, and prints the time each takes.
+
+namespace regex_reference {
+
+std::vector<char> whitespace_chars {' ', '\n', '\t', '\r'};
+std::vector<char> group_begin_chars {'(', '[', '{'};
+std::vector<char> group_end_chars {')', ']', '}'};
+
+std::vector<std::string> parse_sections(std::string const& str) {
+    std::vector<std::string> vec {};
+
+    std::regex section_regex {"\\[([^\\]]+)\\]\\n([^\\[]+)"};
+    std::sregex_iterator next {begin(str), end(str), section_regex};
+    std::sregex_iterator end;
+
+    for (; next != end; ++next) {
+        auto match {*next};
+        vec.push_back(match[1]);
+        vec.push_back(match[2]);
+    }
+
+    return vec;
+}
+
+std::vector<std::string> parse_lines(std::string const& str) {
+    std::vector<std::string> vec {};
+
+    std::regex line_regex {"(.+?)\\n"};
+    std::sregex_iterator next {begin(str), end(str), line_regex};
+    std::sregex_iterator end;
+
+    for (; next != end; ++next) {
+        auto match {*next};
+        vec.push_back(match[1]);
+    }
+
+    return vec;
+}
+
+std::vector<std::string> parse_whitespace_separated_values(std::string const& str) {
+    std::vector<std::string> vec {};
+
+    std::string value {};
+    auto parsing_value {false};
+    unsigned int indent_level {0};
+
+    for (unsigned int i {0}; i < str.size(); ++i) {
+        if (!parsing_value && std::find(std::begin(whitespace_chars), std::end(whitespace_chars), str[i]) == std::end(whitespace_chars)) {
+            parsing_value = true;
+        }
+
+        if (parsing_value) {
+            if (std::find(std::begin(group_begin_chars), std::end(group_begin_chars), str[i]) != std::end(group_begin_chars)) {
+                indent_level += 1;
+            }
+            if (std::find(std::begin(group_end_chars), std::end(group_end_chars), str[i]) != std::end(group_end_chars) && indent_level > 0) {
+                indent_level -= 1;
+            }
+            if (std::find(std::begin(whitespace_chars), std::end(whitespace_chars), str[i]) != std::end(whitespace_chars) && indent_level == 0) {
+                parsing_value = false;
+                vec.push_back(value);
+                value = "";
+                continue;
+            }
+
+            value.push_back(str[i]);
+        }
+    }
+
+    if (value.size() > 0) {
+        vec.push_back(value);
+    }
+
+    return vec;
+}
+
+}
+
+const unsigned int DEFAULT_STEP_COUNT {100000};
+
+// std::regex matches recursively, a few hundred bytes of stack for every character of a section.
+const std::size_t REGEX_STACK_BYTES_PER_CHAR {512};
+
+std::string generate_config(unsigned int step_count) {
+    std::string config {"[generators]\n\"osc.c\"\n\"mul.c\"\n[pipeline]\n"};
+    for (unsigned int i {0}; i < step_count; ++i) {
+        auto input {std::to_string(i)};
+        auto output {std::to_string(i + 1)};
+        config += i % 2 ? "mul (#" + input + " 0.25) (#" + output + ")\n" : "osc (440.5 #" + input + ") (#" + output + ")\n";
+    }
+    config += "[output]\nleft 1\nright 2\n";
+    return config;
+}
+
+unsigned int count_values_lexer(std::string const& config) {
+    unsigned int count {0};
+    auto sections {bzzt::parse_sections(config)};
+    for (unsigned int i {1}; i < sections.size(); i += 2) {
+        for (auto const& line : bzzt::parse_lines(sections[i])) {
+            count += bzzt::parse_whitespace_separated_values(line).size();
+        }
+    }
+    return count;
+}
+
+unsigned int count_values_regex(std::string const& config) {
+    unsigned int count {0};
+    auto sections {regex_reference::parse_sections(config)};
+    for (unsigned int i {1}; i < sections.size(); i += 2) {
+        for (auto const& line : regex_reference::parse_lines(sections[i])) {
+            count += regex_reference::parse_whitespace_separated_values(line).size();
+        }
+    }
+    return count;
+}
+
+struct regex_run {
+    std::string const* config;
+    unsigned int values;
+};
+
+// Runs the regex parser on a thread with a stack large enough for the config, the main thread's
+// would overflow on configs of a few thousand steps. Returns false if no such thread can be made.
+bool count_values_regex_on_large_stack(regex_run& run) {
+    pthread_attr_t attributes {};
+    if (pthread_attr_init(&attributes) != 0) {
+        return false;
+    }
+    auto stack_size {std::max<std::size_t>(run.config->size() * REGEX_STACK_BYTES_PER_CHAR, 1 << 20)};
+    pthread_t thread {};
+    auto started {pthread_attr_setstacksize(&attributes, stack_size) == 0 && pthread_create(&thread, &attributes, [](void* p) -> void* {
+        auto run {static_cast<regex_run*>(p)};
+        run->values = count_values_regex(*run->config);
+        return nullptr;
+    }, &run) == 0};
+    pthread_attr_destroy(&attributes);
+    return started && pthread_join(thread, nullptr) == 0;
+}
+
+// Usage: bench_config_parser [step count]
+int main(int argc, char** argv) {
+    auto step_count {argc > 1 ? static_cast<unsigned int>(std::strtoul(argv[1], nullptr, 10)) : DEFAULT_STEP_COUNT};
+    auto config {generate_config(step_count)};
+
+    auto lexer_start {std::chrono::steady_clock::now()};
+    auto lexer_values {count_values_lexer(config)};
+    auto regex_start {std::chrono::steady_clock::now()};
+    regex_run run {&config, 0};
+    if (!count_values_regex_on_large_stack(run)) {
+        std::cout << "No thread with a stack large enough for the regex parser could be started" << std::endl;
+        return 1;
+    }
+    auto regex_values {run.values};
+    auto end {std::chrono::steady_clock::now()};
+
+    std::chrono::duration<double, std::milli> lexer_time {regex_start - lexer_start};
+    std::chrono::duration<double, std::milli> regex_time {end - regex_start};
+    std::cout << "Config parser, " << step_count << " steps, " << config.size() << " bytes" << std::endl;
+    std::cout << "  lexer: " << lexer_time.count() << " ms, " << lexer_values << " values" << std::endl;
+    std::cout << "  regex: " << regex_time.count() << " ms, " << regex_values << " values" << std::endl;
+    return lexer_values == regex_values ? 0 : 1;
+}
\ No newline at end of file
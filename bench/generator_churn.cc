@@ -0,0 +1,127 @@
+#include "audio_pipeline.hh"
+#include <vector>
+#include <chrono>
+#include <iostream>
+
+// Adds a large patch, then keeps deleting scattered generators with their buffers and adding them
+// back, timing the additions. Allocation cost should stay flat however large the patch gets. Then
+// times loading a patch the way a pipeline config is loaded, all steps in one batch and optimised.
+
+const unsigned int PATCH_SIZE {20000};
+const unsigned int ROUNDS {20};
+const unsigned int DELETIONS_PER_ROUND {200};
+const unsigned int LOAD_SIZE {10000};
+
+std::string const GAIN_GENERATOR_CODE {
+    "unsigned int init(void* generator) { return 1; }\n"
+    "void deinit(void* generator) {}\n"
+    "char const* id() { return \"gain\"; }\n"
+    "unsigned int size() { return sizeof(float); }\n"
+    "unsigned int input_count() { return 2; }\n"
+    "unsigned int output_count() { return 1; }\n"
+    "void run(float* inputs, float* outputs, void* generator, unsigned int sample_rate) {\n"
+    "    outputs[0] = inputs[0] * inputs[1];\n"
+    "}\n"
+};
+
+// Two interleaved chains, step i reading the output of step i - 2. Only the last buffer of the even
+// chain is live, so optimising deletes the odd one.
+bool time_load(bzzt::audio_pipeline& pipeline, bzzt::audio_pipeline::generator_type_handle gain_type) {
+    auto start {std::chrono::steady_clock::now()};
+    auto buffers {pipeline.add_buffers(LOAD_SIZE)};
+    std::vector<bzzt::audio_pipeline::step_description> steps(LOAD_SIZE);
+    for (unsigned int i {0}; i < LOAD_SIZE; ++i) {
+        bzzt::audio_pipeline::input_binding source {};
+        if (i >= 2) {
+            source.is_buffer = true;
+            source.buffer = buffers[i - 2];
+        } else {
+            source.value = 1.0f;
+        }
+        bzzt::audio_pipeline::input_binding gain {};
+        gain.value = 0.5f;
+        steps[i].type = gain_type;
+        steps[i].inputs = {source, gain};
+        steps[i].outputs = {buffers[i]};
+    }
+    auto generators {pipeline.add_generators_back(steps)};
+    auto optimize_start {std::chrono::steady_clock::now()};
+    auto live_buffer {buffers[(LOAD_SIZE - 1) & ~1u]};
+    auto report {pipeline.optimize({live_buffer})};
+    auto end {std::chrono::steady_clock::now()};
+    if (generators.size() != LOAD_SIZE) {
+        return false;
+    }
+
+    std::chrono::duration<double, std::milli> add_time {optimize_start - start};
+    std::chrono::duration<double, std::milli> optimize_time {end - optimize_start};
+    std::cout << "Pipeline load, " << LOAD_SIZE << " steps" << std::endl;
+    std::cout << "  add:            " << add_time.count() << " ms" << std::endl;
+    std::cout << "  optimise:       " << optimize_time.count() << " ms, " << report.removed_steps.size() << " steps removed" << std::endl;
+    return true;
+}
+
+int main() {
+    bzzt::audio_pipeline pipeline {{256, 44100}};
+    auto gain_type {pipeline.add_generator_type(GAIN_GENERATOR_CODE)};
+    if (!pipeline.generator_type_is_valid(gain_type)) {
+        std::cout << "The gain generator could not be compiled" << std::endl;
+        return 1;
+    }
+
+    std::vector<bzzt::audio_pipeline::generator_handle> generators {};
+    std::vector<bzzt::audio_pipeline::buffer_handle> buffers {};
+    for (unsigned int i {0}; i < PATCH_SIZE; ++i) {
+        generators.push_back(pipeline.add_generator_back(gain_type));
+        buffers.push_back(pipeline.add_buffer());
+    }
+
+    // A fixed linear congruential sequence, so every run deletes the same slots.
+    auto seed {1u};
+    auto next_index {[&seed]() {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 8) % PATCH_SIZE;
+    }};
+
+    std::vector<bool> picked(PATCH_SIZE, false);
+    std::vector<unsigned int> indices {};
+    std::chrono::duration<double, std::milli> churn_time {0.0};
+    std::chrono::duration<double, std::milli> add_time {0.0};
+    for (unsigned int round {0}; round < ROUNDS; ++round) {
+        indices.clear();
+        for (unsigned int k {0}; k < DELETIONS_PER_ROUND; ++k) {
+            auto index {next_index()};
+            if (!picked[index]) {
+                picked[index] = true;
+                indices.push_back(index);
+            }
+        }
+
+        auto churn_start {std::chrono::steady_clock::now()};
+        for (auto index : indices) {
+            pipeline.delete_generator(generators[index]);
+            pipeline.delete_buffer(buffers[index]);
+        }
+        auto add_start {std::chrono::steady_clock::now()};
+        for (auto index : indices) {
+            buffers[index] = pipeline.add_buffer();
+            generators[index] = pipeline.add_generator_back(gain_type);
+            picked[index] = false;
+        }
+        auto end {std::chrono::steady_clock::now()};
+        churn_time += end - churn_start;
+        add_time += end - add_start;
+    }
+
+    std::cout << "Generator churn, " << ROUNDS << " rounds of up to " << DELETIONS_PER_ROUND << " in a patch of " << PATCH_SIZE << std::endl;
+    std::cout << "  delete and add: " << churn_time.count() << " ms" << std::endl;
+    std::cout << "  add only:       " << add_time.count() << " ms" << std::endl;
+
+    bzzt::audio_pipeline load_pipeline {{256, 44100}};
+    auto load_gain_type {load_pipeline.add_generator_type(GAIN_GENERATOR_CODE)};
+    if (!time_load(load_pipeline, load_gain_type)) {
+        std::cout << "The patch could not be loaded" << std::endl;
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
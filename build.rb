@@ -1,2 +1,6 @@
-compile_command = %x{clang++ -std=c++17 -Wall -Wextra -pedantic -Iapp/ app/*.cc -ltcc -ldl -lglfw -lsoundio -lGL -lGLU -lGLEW -o build/audiosynth}
+if ARGV.first == "bench"
+  compile_command = %x{clang++ -std=c++17 -O2 -msse4.1 -Wall -Wextra -pedantic -Iapp/ bench/generator_churn.cc app/audio_pipeline.cc app/oversampling.cc app/generator_runtime.cc -ltcc -ldl -o build/bench_generator_churn && clang++ -std=c++17 -O2 -msse4.1 -Wall -Wextra -pedantic -Iapp/ bench/config_parser.cc app/parsers.cc -pthread -o build/bench_config_parser}
+else
+  compile_command = %x{clang++ -std=c++17 -O2 -msse4.1 -Wall -Wextra -pedantic -Iapp/ app/*.cc -pthread -ltcc -ldl -lglfw -lsoundio -lGL -lGLU -lGLEW -o build/audiosynth}
+end
 puts compile_command